@@ -1,10 +1,16 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
+// Each bucket has its own lock, so looking up, releasing and
+// pinning different blocks mostly don't contend. A miss
+// recycles the unused buffer released longest ago in the
+// block's bucket, or failing that steals the one released
+// longest ago from the next bucket that has one.
+//
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
@@ -23,69 +29,138 @@
 #include "fs.h"
 #include "buf.h"
 
-struct {
+#define NBUCKET 13
+#define NOBLOCK (~0U) // dev and blockno of a buffer that holds no block
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;   // chain through next
+} __attribute__((aligned(CACHELINE)));
 
-  // Linked list of all buffers, through prev/next.
-  // Sorted by how recently the buffer was used.
-  // head.next is most recent, head.prev is least.
-  struct buf head;
+struct {
+  struct buf buf[NBUF];
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static struct bucket*
+bucketfor(uint dev, uint blockno)
+{
+  return &bcache.bucket[(dev * 31 + blockno) % NBUCKET];
+}
+
 void
 binit(void)
 {
   struct buf *b;
-
-  initlock(&bcache.lock, "bcache");
-
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  struct bucket *bk;
+  int i;
+
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++)
+    initlock(&bk->lock, "bcache.bucket");
+
+  // Spread the buffers over the buckets.
+  for(i = 0, b = bcache.buf; b < bcache.buf+NBUF; b++, i++){
+    initmutex(&b->lock, "buffer");
+    b->dev = b->blockno = NOBLOCK;
+    bk = &bcache.bucket[i % NBUCKET];
+    b->next = bk->head;
+    bk->head = b;
   }
 }
 
-// Look through buffer cache for block on device dev.
-// If not found, allocate a buffer.
-// In either case, return locked buffer.
+// Find block blockno of device dev in bucket bk, and if it's
+// there take a reference to it. Caller must hold bk->lock.
 static struct buf*
-bget(uint dev, uint blockno)
+bfind(struct bucket *bk, uint dev, uint blockno)
 {
   struct buf *b;
 
-  acquire(&bcache.lock);
-
-  // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = bk->head; b; b = b->next){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
       return b;
     }
   }
+  return 0;
+}
+
+// Find the unused buffer in bucket bk released longest ago,
+// and return the link that points to it, or 0 if every buffer
+// there is in use. Caller must hold bk->lock.
+static struct buf**
+blru(struct bucket *bk)
+{
+  struct buf **pp, **bestpp = 0;
 
-  // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
+  for(pp = &bk->head; *pp; pp = &(*pp)->next)
+    if((*pp)->refcnt == 0 &&
+       (bestpp == 0 || (*pp)->lastuse < (*bestpp)->lastuse))
+      bestpp = pp;
+  return bestpp;
+}
+
+// Look through buffer cache for block on device dev.
+// If not found, allocate a buffer.
+// In either case, return locked buffer.
+static struct buf*
+bget(uint dev, uint blockno)
+{
+  struct bucket *bk = bucketfor(dev, blockno);
+  struct bucket *obk;
+  struct buf *b, **pp;
+  int i;
+
+  // Is the block already cached?
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0)
+    goto found;
+
+  // Not cached. Recycle the least recently used (LRU)
+  // unused buffer in the block's own bucket, if any.
+  if((pp = blru(bk)) != 0){
+    b = *pp;
+    goto recycle;
+  }
+  release(&bk->lock);
+
+  // Steal one from another bucket. Hold one bucket lock at
+  // a time, so there is no lock order to get wrong; once
+  // off its chain, no one else can find the buffer, and it
+  // gives up its old block so no later lookup can match it
+  // wherever it ends up.
+  b = 0;
+  for(i = 1; i < NBUCKET && b == 0; i++){
+    obk = &bcache.bucket[(bk - bcache.bucket + i) % NBUCKET];
+    acquire(&obk->lock);
+    if((pp = blru(obk)) != 0){
+      b = *pp;
+      *pp = b->next;
+      b->dev = b->blockno = NOBLOCK;
       b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
     }
+    release(&obk->lock);
   }
-  panic("bget: no buffers");
+  if(b == 0)
+    panic("bget: no buffers");
+
+  // Another process may have cached the block meanwhile. If
+  // so, leave the stolen buffer unused in this bucket.
+  acquire(&bk->lock);
+  b->next = bk->head;
+  bk->head = b;
+  if((b = bfind(bk, dev, blockno)) != 0)
+    goto found;
+  b = bk->head;
+
+ recycle:
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+ found:
+  release(&bk->lock);
+  acquiresleep(&b->lock);
+  return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -112,42 +187,41 @@ bwrite(struct buf *b)
 }
 
 // Release a locked buffer.
-// Move to the head of the most-recently-used list.
+// Note when it became unused, for recycling in LRU order.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = bucketfor(b->dev, b->blockno);
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    b->lastuse = r_time();
   }
-  
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bucketfor(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt++;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
 void
 bunpin(struct buf *b) {
-  acquire(&bcache.lock);
+  struct bucket *bk = bucketfor(b->dev, b->blockno);
+
+  acquire(&bk->lock);
   b->refcnt--;
-  release(&bcache.lock);
+  release(&bk->lock);
 }
-
-
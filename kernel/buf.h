@@ -5,8 +5,8 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
-  struct buf *prev; // LRU cache list
-  struct buf *next;
+  uint64 lastuse;   // when refcnt last became 0, for LRU
+  struct buf *next; // hash bucket chain
   uchar data[BSIZE];
 };
 
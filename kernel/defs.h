@@ -4,8 +4,13 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct runq;
+struct timer;
 struct spinlock;
+struct rwspinlock;
+struct seqlock;
 struct sleeplock;
+struct lockstat;
 struct stat;
 struct superblock;
 
@@ -40,6 +45,7 @@ int             dirlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
 struct inode*   ialloc(uint, short);
 struct inode*   idup(struct inode*);
+struct inode*   cwdget(void);
 void            iinit();
 void            ilock(struct inode*);
 void            iput(struct inode*);
@@ -84,7 +90,11 @@ void            printfinit(void);
 int             cpuid(void);
 void            kexit(int);
 int             kfork(void);
-int             growproc(int);
+int             kclone(uint64, uint64, uint64);
+int             kjoin(int);
+int             kthreadcreate(void (*)(void*), void*, char*);
+void            kthreadexit(void) __attribute__((noreturn));
+uint64          growproc(int, int);
 void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -97,32 +107,107 @@ struct proc*    myproc();
 void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             schedtick(void);
+int             priboost(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             kwait(uint64);
 int				kwait2(uint64, uint64);
 void            wakeup(void*);
+int             wakeupn(void*, int);
+void            wakeupone(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+int             setsched(int, int, int);
+int             getsched(int, int*);
+int             needresched(void);
+int             condresched(struct spinlock*);
+int             setaffinity(int, uint64);
+int             getaffinity(int, uint64*, int*);
+int             schedstat(int, int, uint64);
+void            piboost(struct proc*, int);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
 
 // spinlock.c
 void            acquire(struct spinlock*);
+int             tryacquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+void            initrwlock(struct rwspinlock*, char*);
+void            acquireread(struct rwspinlock*);
+void            releaseread(struct rwspinlock*);
+void            acquirewrite(struct rwspinlock*);
+void            releasewrite(struct rwspinlock*);
+void            initseqlock(struct seqlock*, char*);
+uint            seqreadbegin(struct seqlock*);
+int             seqreadretry(struct seqlock*, uint);
+void            seqwritebegin(struct seqlock*);
+void            seqwriteend(struct seqlock*);
+int             irqoffstat(uint64, int, int);
+int             lockbench(int, int);
+
+// runq.c
+void            runqinit(struct runq*);
+void            runqput(struct proc*);
+int             runqremove(struct proc*);
+struct proc*    runqget(struct cpu*);
+struct proc*    runqsteal(struct cpu*);
+struct proc*    runqstale(struct runq*, uint);
+int             runqpreempt(struct cpu*, struct proc*);
+void            runqmigrate(struct proc*, struct cpu*);
+void            runqrtcharge(struct cpu*, uint64);
+void            runqmlfqcharge(struct cpu*, uint64);
+int             runqrank(struct proc*);
+
+// timer.c
+void            timerqinit(void);
+void            inittimer(struct timer*, void (*)(struct timer*), void*);
+void            timerarm(void);
+void            timeradd(struct timer*, uint64);
+int             timerdel(struct timer*);
+void            timerexpire(void);
+int             timersleep(uint64);
+
+// ipi.c
+void            ipisend(int);
+void            ipiintr(void);
+void            tlbshootdown(pagetable_t);
+
+// futex.c
+void            futexinit(void);
+int             futexwait(uint64, int, uint64);
+int             futexwake(uint64, int);
+
+// pcount.c
+void            pcountinc(int);
+uint64          pcountsum(int);
+int             pcount(int, uint64);
+
+// lockstat.c
+struct lockstat* lockstatfor(char*, int);
+void            lockstatacquired(struct lockstat*, int, uint64);
+void            lockstatreleased(struct lockstat*, uint64);
+int             lockstat(uint64, int, int);
+
+// reclaim.c
+void            reclaiminit(void);
+void            reclaim(struct proc*);
+int             reclaimwait(void);
+int             reclaimstat(uint64);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
 int             holdingsleep(struct sleeplock*);
 void            initsleeplock(struct sleeplock*, char*);
+void            initmutex(struct sleeplock*, char*);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -142,10 +227,9 @@ int             fetchaddr(uint64, uint64*);
 void            syscall();
 
 // trap.c
-extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
-extern struct spinlock tickslock;
+uint            uptimeticks(void);
 void            prepare_return(void);
 
 // uart.c
@@ -163,7 +247,8 @@ int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 uint64          uvmalloc(pagetable_t, uint64, uint64, int);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
-int             uvmcopy(pagetable_t, pagetable_t, uint64);
+uint64          uvmdeallocshared(pagetable_t, uint64, uint64);
+uint64          uvmcopy(pagetable_t, pagetable_t, uint64*, struct spinlock*);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
@@ -180,6 +265,13 @@ void            plicinit(void);
 void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
+int             plicroute(int, int);
+
+// irqthread.c
+void            irqdefer(int, void (*)(void), char*);
+void            irqthreadinit(void);
+void            irqwake(int);
+int             irqroute(int, int);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
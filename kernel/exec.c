@@ -35,6 +35,11 @@ kexec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // exec() replaces the whole address space, which other
+  // threads are still running in.
+  if(p->leader != p || p->threads || p->tzombies)
+    return -1;
+
   begin_op();
 
   // Open the executable file.
@@ -165,7 +170,7 @@ kexec(char *path, char **argv)
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
 
-  p->mmap = TRAPFRAME - (USERSTACK * PGSIZE);
+  p->mmap = MMAPTOP - (USERSTACK * PGSIZE);
   p->mmap_pages = 0;
   
   proc_freepagetable(oldpagetable, oldsz);
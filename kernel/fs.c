@@ -165,17 +165,20 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
+// The itable.lock reader-writer spin-lock protects the allocation
+// of itable entries. Since ip->ref indicates whether an entry is
+// free, and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
+// Lookups hold it only for reading, so they don't keep each other
+// waiting, and may increment ip->ref, atomically; anything else
+// that changes those fields must hold it for writing.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
-  struct spinlock lock;
+  struct rwspinlock lock;
   struct inode inode[NINODE];
 } itable;
 
@@ -184,9 +187,9 @@ iinit()
 {
   int i = 0;
   
-  initlock(&itable.lock, "itable");
+  initrwlock(&itable.lock, "itable");
   for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
+    initmutex(&itable.inode[i].lock, "inode");
   }
 }
 
@@ -249,14 +252,25 @@ iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
 
-  acquire(&itable.lock);
-
   // Is the inode already in the table?
+  acquireread(&itable.lock);
+  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
+    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+      __atomic_fetch_add(&ip->ref, 1, __ATOMIC_RELAXED);
+      releaseread(&itable.lock);
+      return ip;
+    }
+  }
+  releaseread(&itable.lock);
+
+  // No; look again with the lock held for writing, since
+  // another process may have added it in the meantime.
+  acquirewrite(&itable.lock);
   empty = 0;
   for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
       ip->ref++;
-      release(&itable.lock);
+      releasewrite(&itable.lock);
       return ip;
     }
     if(empty == 0 && ip->ref == 0)    // Remember empty slot.
@@ -272,7 +286,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&itable.lock);
+  releasewrite(&itable.lock);
 
   return ip;
 }
@@ -282,9 +296,24 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
-  ip->ref++;
-  release(&itable.lock);
+  acquireread(&itable.lock);
+  __atomic_fetch_add(&ip->ref, 1, __ATOMIC_RELAXED);
+  releaseread(&itable.lock);
+  return ip;
+}
+
+// Return a new reference to the current directory.
+// Threads share it through their group leader, and
+// another thread may chdir() at any time.
+struct inode*
+cwdget(void)
+{
+  struct proc *g = myproc()->leader;
+  struct inode *ip;
+
+  acquire(&g->glock);
+  ip = idup(g->cwd);
+  release(&g->glock);
   return ip;
 }
 
@@ -337,7 +366,7 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  acquirewrite(&itable.lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -346,7 +375,7 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    releasewrite(&itable.lock);
 
     itrunc(ip);
     ip->type = 0;
@@ -355,11 +384,11 @@ iput(struct inode *ip)
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    acquirewrite(&itable.lock);
   }
 
   ip->ref--;
-  release(&itable.lock);
+  releasewrite(&itable.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -679,7 +708,7 @@ namex(char *path, int nameiparent, char *name)
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = cwdget();
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
@@ -752,10 +781,9 @@ diriname(struct inode *dp, ushort inum, char name[DIRSIZ], ushort *iparent)
   return -1;
 }
 
-int
-getcwd(char *buf, uint size)
+static int
+getcwd1(struct inode *ip, char *buf, uint size)
 {
-  struct inode *ip = myproc()->cwd;
   ilock(ip);
 
   if(ip->type != T_DIR)
@@ -811,3 +839,14 @@ getcwd(char *buf, uint size)
 
   return 0;
 }
+
+int
+getcwd(char *buf, uint size)
+{
+  struct inode *ip = cwdget();
+  int r;
+
+  r = getcwd1(ip, buf, size);
+  iput(ip);
+  return r;
+}
@@ -0,0 +1,192 @@
+// Futexes: sleeping on a word of user memory.
+//
+// futexwait() sleeps only if the word still holds the value
+// the caller expected, and futexwake() wakes sleepers on a
+// word. User code keeps the fast path in user space and
+// only calls in to block or to wake a blocked thread.
+//
+// Waiters are keyed by the word's physical address, so
+// threads sharing a page table and processes that map the
+// same page both find each other. Each waiter is a record
+// on its own kernel stack, queued in FIFO order on a hash
+// bucket; the bucket lock covers both the value check and
+// the queueing, so a wakeup can't slip in between.
+//
+// Lock order: the timer queue lock, then the bucket lock,
+// then wait queue and proc locks.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+#define NFUTEX 64
+
+struct futexq {
+  struct spinlock lock;
+  struct futexwaiter *head;
+} __attribute__((aligned(CACHELINE)));
+
+// the bucket lock must be held to use these.
+enum futexstate { FUTEX_WAITING, FUTEX_WOKEN, FUTEX_TIMEDOUT, FUTEX_GONE };
+
+struct futexwaiter {
+  uint64 pa;                // Physical address of the word
+  struct futexq *q;         // Bucket for pa
+  struct futexwaiter *next; // Next waiter in q
+  enum futexstate state;
+  struct timer timer;       // For a timeout
+};
+
+static struct futexq futexq[NFUTEX];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEX; i++)
+    initlock(&futexq[i].lock, "futex");
+}
+
+static struct futexq*
+futexqfor(uint64 pa)
+{
+  // Fibonacci hashing, as for the wait queues.
+  return &futexq[(pa * 0x9E3779B97F4A7C15ULL) >> 58];
+}
+
+// Translate the user address of a futex word into its
+// physical address, faulting in a lazily allocated page
+// if alloc is set. Returns 0 if uaddr isn't a mapped,
+// aligned user address.
+static uint64
+futexaddr(uint64 uaddr, int alloc)
+{
+  pagetable_t pagetable = myproc()->pagetable;
+  uint64 va = PGROUNDDOWN(uaddr), pa;
+
+  if(uaddr % sizeof(int) != 0 || uaddr >= MAXVA)
+    return 0;
+  if((pa = walkaddr(pagetable, va)) == 0 && alloc)
+    pa = vmfault(pagetable, va, 1);
+  if(pa == 0)
+    return 0;
+  return pa + (uaddr - va);
+}
+
+// Take w off its bucket.
+// Caller must hold w->q->lock.
+static void
+futexunlink(struct futexwaiter *w)
+{
+  struct futexwaiter **pp;
+
+  for(pp = &w->q->head; *pp; pp = &(*pp)->next){
+    if(*pp == w){
+      *pp = w->next;
+      break;
+    }
+  }
+  w->next = 0;
+}
+
+// Timer callback for futexwait()'s timeout.
+static void
+futextimeout(struct timer *t)
+{
+  struct futexwaiter *w = t->arg;
+
+  acquire(&w->q->lock);
+  if(w->state == FUTEX_WAITING){
+    futexunlink(w);
+    w->state = FUTEX_TIMEDOUT;
+    wakeup(w);
+  }
+  release(&w->q->lock);
+}
+
+// If the int at user address uaddr holds val, sleep until
+// futexwake() on it, or until the time CSR reaches deadline
+// if deadline isn't 0. Returns 0 if woken, -1 if the word
+// didn't hold val, uaddr was bad or the process was
+// killed, and -2 on timeout.
+int
+futexwait(uint64 uaddr, int val, uint64 deadline)
+{
+  struct futexwaiter w, **pp;
+  struct proc *p = myproc();
+  int r;
+
+  if((w.pa = futexaddr(uaddr, 1)) == 0)
+    return -1;
+  w.q = futexqfor(w.pa);
+  w.next = 0;
+  w.state = FUTEX_WAITING;
+  inittimer(&w.timer, futextimeout, &w);
+
+  // add the timer before taking the bucket lock, which
+  // the callback takes inside the timer queue lock.
+  if(deadline != 0)
+    timeradd(&w.timer, deadline);
+
+  // the timer may already have fired; if so w is
+  // FUTEX_TIMEDOUT and must not be linked.
+  acquire(&w.q->lock);
+  if(*(volatile int *)w.pa != val){
+    w.state = FUTEX_GONE;
+  } else if(w.state == FUTEX_WAITING){
+    for(pp = &w.q->head; *pp; pp = &(*pp)->next)
+      ;
+    *pp = &w;
+    while(w.state == FUTEX_WAITING){
+      if(killed(p)){
+        futexunlink(&w);
+        w.state = FUTEX_GONE;
+        break;
+      }
+      sleep(&w, &w.q->lock);
+    }
+  }
+  r = w.state == FUTEX_WOKEN ? 0 : w.state == FUTEX_TIMEDOUT ? -2 : -1;
+  release(&w.q->lock);
+
+  // w is on this stack, so the callback must be done
+  // with it before returning.
+  timerdel(&w.timer);
+  return r;
+}
+
+// Wake up to n of the processes sleeping in futexwait()
+// on the int at user address uaddr, oldest first, or all
+// of them if n is negative. Returns the number woken.
+int
+futexwake(uint64 uaddr, int n)
+{
+  struct futexwaiter *w, **pp;
+  struct futexq *q;
+  uint64 pa;
+  int woken = 0;
+
+  // an unmapped page can't have waiters.
+  if((pa = futexaddr(uaddr, 0)) == 0)
+    return 0;
+  q = futexqfor(pa);
+
+  acquire(&q->lock);
+  for(pp = &q->head; (w = *pp) != 0 && woken != n; ){
+    if(w->pa != pa){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->next = 0;
+    w->state = FUTEX_WOKEN;
+    wakeup(w);
+    woken++;
+  }
+  release(&q->lock);
+  return woken;
+}
@@ -0,0 +1,74 @@
+// Inter-processor interrupts.
+//
+// Supervisor mode can't interrupt another hart by itself. It
+// writes the target's MSIP register in the CLINT, which raises
+// a machine software interrupt there; machinevec in kernelvec.S
+// turns that into a supervisor software interrupt, and devintr()
+// calls ipiintr().
+//
+// An IPI carries no message. Taking the trap is the point:
+// a hart in wfi wakes up and looks at its run queue, and one
+// running a process goes through usertrap() or kerneltrap(),
+// which check needresched(). It also gets a hart running user
+// code into the kernel, which tlbshootdown() relies on.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+// Interrupt CPU id.
+void
+ipisend(int id)
+{
+  // make the caller's stores, such as a run queue
+  // insertion, visible before the target wakes.
+  __sync_synchronize();
+  *(volatile uint32 *)CLINT_MSIP(id) = 1;
+}
+
+// A supervisor software interrupt: clear it.
+// Called from devintr().
+void
+ipiintr(void)
+{
+  w_sip(r_sip() & ~SIP_SSIP);
+}
+
+// The caller has removed mappings from pagetable, which other
+// CPUs may be using in user space right now, and must not free
+// the pages until they have stopped. A CPU in the kernel is on
+// the kernel page table, and every return to user space flushes
+// the TLB (see trampoline.S), so only wait for each CPU that
+// is in user space with pagetable to trap into the kernel,
+// and interrupt it so that it does so promptly.
+void
+tlbshootdown(pagetable_t pagetable)
+{
+  uint64 seq[NCPU];
+  struct proc *p;
+  int id, me, waiting;
+
+  push_off();
+  me = cpuid();
+  __sync_synchronize();
+  for(id = 0; id < NCPU; id++){
+    seq[id] = __atomic_load_n(&cpus[id].userseq, __ATOMIC_ACQUIRE);
+    p = cpus[id].proc;
+    if(id == me || (seq[id] & 1) == 0 || p == 0 || p->pagetable != pagetable)
+      seq[id] = 0;
+    else
+      ipisend(id);
+  }
+  do {
+    waiting = 0;
+    for(id = 0; id < NCPU; id++)
+      if(seq[id] != 0 &&
+         __atomic_load_n(&cpus[id].userseq, __ATOMIC_ACQUIRE) == seq[id])
+        waiting = 1;
+  } while(waiting);
+  pop_off();
+}
@@ -0,0 +1,11 @@
+// Interrupts-off sections, for irqoffstat(). Only a kernel
+// built with LATTRACE=1 records them. Each site is the code
+// that turned interrupts off with push_off() or acquire();
+// look pc up with addr2line -e kernel/kernel.
+#define NIRQOFF 64
+struct irqoff {
+  uint64 pc;     // Where interrupts were turned off
+  uint64 count;  // Times, with interrupts enabled again after
+  uint64 max;    // Longest, in microseconds
+  uint64 total;  // Total time, in microseconds
+};
@@ -0,0 +1,121 @@
+// Threaded interrupt handlers.
+//
+// A device's interrupt handler does only what must happen
+// at once, such as acknowledging the device, and calls
+// irqwake(). The rest of the work runs in a kernel thread
+// for the IRQ, with interrupts on and at the top real-time
+// priority, so it can be preempted and the CPU that took
+// the interrupt gets its interrupts back sooner.
+//
+// irqroute() sends an IRQ to one CPU and keeps its thread
+// there too, so the completion work shares that CPU's cache
+// with the interrupt.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sched.h"
+#include "defs.h"
+
+#define NIRQTHREAD 4
+
+struct irqthread {
+  struct spinlock lock;
+  int irq;
+  void (*fn)(void);   // the deferred work
+  char *name;
+  int pending;        // irqwake() since fn last started
+  int pid;
+};
+
+static struct irqthread irqthreads[NIRQTHREAD];
+static int nirqthread;
+
+// Run fn in a thread of its own whenever irqwake(irq) is
+// called. For device initialization, before irqthreadinit().
+void
+irqdefer(int irq, void (*fn)(void), char *name)
+{
+  struct irqthread *t;
+
+  if(nirqthread == NIRQTHREAD)
+    panic("irqdefer");
+  t = &irqthreads[nirqthread++];
+  initlock(&t->lock, name);
+  t->irq = irq;
+  t->fn = fn;
+  t->name = name;
+}
+
+static struct irqthread*
+irqthreadfor(int irq)
+{
+  for(int i = 0; i < nirqthread; i++)
+    if(irqthreads[i].irq == irq)
+      return &irqthreads[i];
+  return 0;
+}
+
+static void
+irqthread(void *arg)
+{
+  struct irqthread *t = arg;
+
+  acquire(&t->lock);
+  for(;;){
+    while(t->pending == 0)
+      sleep(&t->pending, &t->lock);
+    t->pending = 0;
+    release(&t->lock);
+    t->fn();
+    acquire(&t->lock);
+  }
+}
+
+// Start the threads, once processes can be created.
+void
+irqthreadinit(void)
+{
+  struct irqthread *t;
+
+  for(t = irqthreads; t < &irqthreads[nirqthread]; t++){
+    if((t->pid = kthreadcreate(irqthread, t, t->name)) < 0)
+      panic("irqthreadinit");
+    setsched(t->pid, SCHED_FIFO, NRTPRIO);
+  }
+}
+
+// Run irq's deferred work soon. Called from its interrupt
+// handler.
+void
+irqwake(int irq)
+{
+  struct irqthread *t = irqthreadfor(irq);
+
+  acquire(&t->lock);
+  t->pending = 1;
+  wakeup(&t->pending);
+  release(&t->lock);
+}
+
+// Send irq to CPU cpu, and run its thread there. If cpu is
+// -1, just return irq's CPU. Returns -1 if there is no such
+// IRQ or CPU.
+int
+irqroute(int irq, int cpu)
+{
+  struct irqthread *t;
+
+  if(cpu < 0)
+    return plicroute(irq, -1);
+  if(cpu >= NCPU || (cpusonline & (1UL << cpu)) == 0)
+    return -1;
+  if(plicroute(irq, cpu) < 0)
+    return -1;
+  if((t = irqthreadfor(irq)) != 0 && t->pid > 0)
+    setaffinity(t->pid, 1UL << cpu);
+  return cpu;
+}
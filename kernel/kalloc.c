@@ -7,6 +7,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "pcount.h"
 #include "defs.h"
 
 // Store a reference count for each physical page
@@ -96,6 +97,7 @@ kfree(void *pa)
   kmem.freelist = r;
 
   release(&kmem.lock);
+  pcountinc(PC_KFREE);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -114,25 +116,18 @@ kalloc(void)
   }
   release(&kmem.lock);
 
-  if(r)
+  if(r){
+    pcountinc(PC_KALLOC);
     memset((char*)r, 5, PGSIZE);
+  }
 
   return (void*)r;
 }	
 
+// The number of free pages, from the allocation counters
+// rather than a walk of the free list.
 uint64
 kfreepages(void)
 {
-	uint64 num_pages = 0;
-	struct run *r;
-
-	acquire(&kmem.lock);
-	r = kmem.freelist;
-	while (r) {
-		num_pages++;
-		r = r->next;
-	}
-	release(&kmem.lock);
-
-	return num_pages;
+  return pcountsum(PC_KFREE) - pcountsum(PC_KALLOC);
 }
@@ -0,0 +1,121 @@
+// Lock contention statistics.
+//
+// In a kernel built with LOCKSTAT, initlock() and
+// initsleeplock() point each lock at the record for its
+// name, and acquiring and releasing it update the record.
+// Records are shared by every CPU, so they are updated with
+// atomic instructions; this is for finding hot locks, not
+// for production kernels.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "lockstat.h"
+#include "defs.h"
+
+#ifdef LOCKSTAT
+static struct lockstat stats[NLOCKSTAT];
+static int nstats;
+
+// Guards adding records. Not a struct spinlock, whose
+// initlock() comes here.
+static uint statslock;
+
+// The record for locks called name, or 0 if there are too
+// many names.
+struct lockstat*
+lockstatfor(char *name, int sleep)
+{
+  struct lockstat *st;
+  int i;
+
+  if(name == 0)
+    return 0;
+  push_off();
+  while(__sync_lock_test_and_set(&statslock, 1) != 0)
+    ;
+  __sync_synchronize();
+  for(i = 0; i < nstats; i++)
+    if(stats[i].sleep == sleep && strncmp(stats[i].name, name, sizeof(stats[i].name)) == 0)
+      break;
+  st = 0;
+  if(i < nstats){
+    st = &stats[i];
+  } else if(nstats < NLOCKSTAT){
+    st = &stats[nstats++];
+    safestrcpy(st->name, name, sizeof(st->name));
+    st->sleep = sleep;
+  }
+  __sync_synchronize();
+  __sync_lock_release(&statslock);
+  pop_off();
+  return st;
+}
+
+// A lock counted in st was acquired, after waiting for
+// waited cycles if contended is set.
+void
+lockstatacquired(struct lockstat *st, int contended, uint64 waited)
+{
+  if(st == 0)
+    return;
+  __atomic_fetch_add(&st->acquires, 1, __ATOMIC_RELAXED);
+  if(contended){
+    __atomic_fetch_add(&st->contended, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&st->waittime, waited, __ATOMIC_RELAXED);
+  }
+}
+
+// A lock counted in st is being released after being held
+// for held cycles.
+void
+lockstatreleased(struct lockstat *st, uint64 held)
+{
+  uint64 max;
+
+  if(st == 0)
+    return;
+  max = __atomic_load_n(&st->maxhold, __ATOMIC_RELAXED);
+  while(held > max &&
+        !__atomic_compare_exchange_n(&st->maxhold, &max, held, 0,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+#endif
+
+// Copy up to n lock records to user address addr, and
+// clear the counts if reset is set. Returns the number of
+// records, or -1 if the kernel wasn't built with LOCKSTAT.
+int
+lockstat(uint64 addr, int n, int reset)
+{
+#ifdef LOCKSTAT
+  struct lockstat *st;
+  int i;
+
+  if(n > nstats)
+    n = nstats;
+  if(n < 0)
+    n = 0;
+  // too big for the stack.
+  if((st = kalloc()) == 0)
+    return -1;
+  for(i = 0; i < n; i++)
+    st[i] = stats[i];
+  if(reset){
+    for(i = 0; i < nstats; i++){
+      stats[i].acquires = stats[i].contended = 0;
+      stats[i].waittime = stats[i].maxhold = 0;
+    }
+  }
+  if(n > 0 && copyout(myproc()->pagetable, addr, (char *)st, n * sizeof(*st)) < 0)
+    n = -1;
+  kfree(st);
+  return n;
+#else
+  return -1;
+#endif
+}
@@ -0,0 +1,14 @@
+// Lock contention statistics, for lockstat(). Only a kernel
+// built with LOCKSTAT=1 keeps them. Locks are counted by
+// name, so all the locks of one kind, such as the per-process
+// locks, add up into one record. Times are in cycles of the
+// time CSR.
+#define NLOCKSTAT 64
+struct lockstat {
+  char name[16];
+  int sleep;         // Sleep locks, rather than spinlocks
+  uint64 acquires;   // Times acquired
+  uint64 contended;  // Times the acquirer had to wait
+  uint64 waittime;   // Total time spent waiting
+  uint64 maxhold;    // Longest time held
+};
@@ -20,6 +20,8 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    timerqinit();    // per-CPU timer queues
+    futexinit();     // futex wait queues
     trapinit();      // trap vectors
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
@@ -29,6 +31,8 @@ main()
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
+    reclaiminit();   // user memory reclaimer
+    irqthreadinit(); // threads for device interrupts
     __sync_synchronize();
     started = 1;
   } else {
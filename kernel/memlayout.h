@@ -31,6 +31,11 @@
 // qemu "test" device for signaling exit/status
 #define VIRT_TEST 0x100000
 
+// core local interruptor (CLINT). writing 1 to a hart's
+// MSIP register raises a machine software interrupt there.
+#define CLINT 0x2000000L
+#define CLINT_MSIP(hart) (CLINT + 4*(hart))
+
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
 #define PLIC_PRIORITY (PLIC + 0x0)
@@ -60,6 +65,13 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   mmap region, growing down from MMAPTOP
+//   other threads' trapframes
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// each thread of a process has its trapframe at
+// THREADFRAME(p->tslot); the first thread's is TRAPFRAME.
+#define THREADFRAME(slot) (TRAPFRAME - (uint64)(slot)*PGSIZE)
+#define MMAPTOP THREADFRAME(NTHREAD)
@@ -1,6 +1,26 @@
 #define NPROC        64  // maximum number of processes
-#define NCPU          8  // maximum number of CPUs
+#define NCPU         64  // maximum number of CPUs (at most 64)
+#define CACHELINE    64  // bytes; CPUs shouldn't share a line they write
+#define NPRIO         4  // scheduling priority levels (priority = 3 - nice)
+#ifndef HZ
+#define HZ           10  // timer interrupts per second (make HZ=...)
+#endif
+#define TIMEBASE 10000000 // time CSR frequency on qemu virt, cycles per second
+#define TICKCYCLES (TIMEBASE/HZ) // cycles per clock tick
+#define MSTICKS(ms) (HZ*(ms)/1000 > 0 ? HZ*(ms)/1000 : 1) // ticks in ms, at least 1
+#define BOOSTTICKS   HZ  // ticks between MLFQ priority boosts (one second)
+#define FAIRGRAN  1000000 // cycles a fair process may get ahead before preemption
+#define NRTPRIO       8  // real-time priorities, 1..NRTPRIO
+#ifndef RRMS
+#define RRMS        100  // SCHED_RR time quantum, in ms (make RRMS=...)
+#endif
+#define RRTICKS MSTICKS(RRMS) // SCHED_RR time quantum, in ticks
+#define RTPERIOD TIMEBASE // real-time throttling period, in cycles
+#define RTRUNTIME (RTPERIOD/20*19) // real-time CPU time allowed per period
+#define MLFQRUNTIME (RTPERIOD/4*3) // MLFQ CPU time allowed per period while fair processes wait
 #define NOFILE       16  // open files per process
+#define NTHREAD      16  // threads per process, including the first
+#define RECLAIMTRIES  3  // times a failed allocation waits for the reclaimer
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
 #define NDEV         10  // maximum major device number
@@ -12,4 +32,5 @@
 #define FSSIZE       4000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 #define USERSTACK    1     // user stack pages
+#define COPYBATCH   16     // pages copied, grown or freed between preemption points
 
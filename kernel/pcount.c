@@ -0,0 +1,62 @@
+// Per-CPU event counters.
+//
+// A counter that every CPU bumps would bounce its cache line
+// between them on every event. Instead each CPU counts in a
+// line of its own, without locks or atomics, and a reader
+// adds the CPUs' counts up. A sum read while other CPUs are
+// counting is a moment out of date, which is all a statistic
+// needs.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "pcount.h"
+#include "defs.h"
+
+struct pcounts {
+  uint64 n[NPCOUNT];
+} __attribute__((aligned(CACHELINE)));
+
+static struct pcounts pcounts[NCPU];
+
+// Count one event of kind i on this CPU.
+void
+pcountinc(int i)
+{
+  push_off();
+  pcounts[cpuid()].n[i]++;
+  pop_off();
+}
+
+// The number of events of kind i on all CPUs.
+uint64
+pcountsum(int i)
+{
+  uint64 sum = 0;
+
+  for(int id = 0; id < NCPU; id++)
+    sum += __atomic_load_n(&pcounts[id].n[i], __ATOMIC_RELAXED);
+  return sum;
+}
+
+// Copy CPU cpu's counters, or if cpu is -1 the sums over
+// all CPUs, to user address addr. Returns 0, or -1 if there
+// is no such CPU.
+int
+pcount(int cpu, uint64 addr)
+{
+  uint64 n[NPCOUNT];
+
+  if(cpu < -1 || cpu >= NCPU || (cpu >= 0 && (cpusonline & (1UL << cpu)) == 0))
+    return -1;
+  for(int i = 0; i < NPCOUNT; i++){
+    if(cpu < 0)
+      n[i] = pcountsum(i);
+    else
+      n[i] = __atomic_load_n(&pcounts[cpu].n[i], __ATOMIC_RELAXED);
+  }
+  return copyout(myproc()->pagetable, addr, (char *)n, sizeof(n));
+}
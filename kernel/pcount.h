@@ -0,0 +1,9 @@
+// Per-CPU event counters, for pcount().
+#define PC_SYSCALL  0  // System calls
+#define PC_DEVINTR  1  // Device interrupts
+#define PC_TIMER    2  // Timer interrupts
+#define PC_IPI      3  // Inter-processor interrupts taken
+#define PC_PGFAULT  4  // Lazily allocated user pages
+#define PC_KALLOC   5  // Pages allocated
+#define PC_KFREE    6  // Pages freed
+#define NPCOUNT     7
@@ -2,18 +2,45 @@
 #include "param.h"
 #include "memlayout.h"
 #include "riscv.h"
+#include "spinlock.h"
 #include "defs.h"
 
 //
 // the riscv Platform Level Interrupt Controller (PLIC).
 //
+// each device IRQ is enabled on one hart only, so that its
+// interrupts always go to the same CPU. they start on hart
+// 0; see plicroute().
+//
+
+static int irqs[] = { UART0_IRQ, VIRTIO0_IRQ };
+
+static struct spinlock pliclock;
+static int route[32];   // hart each IRQ goes to
 
 void
 plicinit(void)
 {
+  initlock(&pliclock, "plic");
+
   // set desired IRQ priorities non-zero (otherwise disabled).
-  *(uint32*)(PLIC + UART0_IRQ*4) = 1;
-  *(uint32*)(PLIC + VIRTIO0_IRQ*4) = 1;
+  for(int i = 0; i < NELEM(irqs); i++){
+    *(uint32*)(PLIC + irqs[i]*4) = 1;
+    route[irqs[i]] = 0;
+  }
+}
+
+// write hart's S-mode enable bits for the IRQs routed to it.
+// caller must hold pliclock.
+static void
+plicenable(int hart)
+{
+  uint32 bits = 0;
+
+  for(int i = 0; i < NELEM(irqs); i++)
+    if(route[irqs[i]] == hart)
+      bits |= 1 << irqs[i];
+  *(uint32*)PLIC_SENABLE(hart) = bits;
 }
 
 void
@@ -21,14 +48,40 @@ plicinithart(void)
 {
   int hart = cpuid();
   
-  // set enable bits for this hart's S-mode
-  // for the uart and virtio disk.
-  *(uint32*)PLIC_SENABLE(hart) = (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
+  acquire(&pliclock);
+  plicenable(hart);
+  release(&pliclock);
 
   // set this hart's S-mode priority threshold to 0.
   *(uint32*)PLIC_SPRIORITY(hart) = 0;
 }
 
+// route irq to hart, or if hart is -1 just return the hart
+// it goes to. returns -1 if irq isn't a device's.
+int
+plicroute(int irq, int hart)
+{
+  int i, old;
+
+  for(i = 0; i < NELEM(irqs); i++)
+    if(irqs[i] == irq)
+      break;
+  if(i == NELEM(irqs))
+    return -1;
+
+  acquire(&pliclock);
+  old = route[irq];
+  if(hart >= 0 && hart != old){
+    // enable on the new hart before disabling on the
+    // old, so that some hart always takes irq.
+    route[irq] = hart;
+    plicenable(hart);
+    plicenable(old);
+  }
+  release(&pliclock);
+  return hart >= 0 ? hart : old;
+}
+
 // ask the PLIC what interrupt we should serve.
 int
 plic_claim(void)
@@ -4,19 +4,72 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sched.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
+uint64 cpusonline;
 
 struct proc proc[NPROC];
 
 struct proc *initproc;
 
 int nextpid = 1;
-struct spinlock pid_lock;
+
+// Processes hashed by pid, for kkill() and findproc().
+// Protected by pid_lock, which lookups only read-lock.
+// Lock order: p->lock, then pid_lock.
+struct rwspinlock pid_lock;
+#define NPIDHASH 64
+static struct proc *pidhash[NPIDHASH];
+
+// MLFQ time quantum, in ticks, for each priority level.
+// Higher levels are for interactive processes and get
+// short slices; CPU hogs sink to long ones.
+static int quantum[NPRIO] = {
+  MSTICKS(800), MSTICKS(400), MSTICKS(200), MSTICKS(100)
+};
+
+// SCHED_FAIR weight for each nice value. A process's
+// virtual runtime advances at 1024/weight times the rate
+// of real time, so CPU shares are proportional to weight.
+static int fairweight[4] = { 1024, 512, 256, 128 };
+
+// Sleeping processes, hashed by wait channel, so that
+// wakeup() only has to look at processes that are
+// actually waiting on its channel. Each bucket is a
+// FIFO, oldest sleeper first, so wakeupone() is fair.
+// Lock order: the bucket lock, then p->lock.
+#define NWAITQ 64
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+  struct proc *tail;
+} __attribute__((aligned(CACHELINE)));
+static struct waitq waitq[NWAITQ];
+
+// Scheduler statistics, kept apart from struct proc and
+// struct cpu so that only this file needs struct schedstat.
+// pstat[i] is protected by proc[i].lock; cstat[i] is only
+// written by CPU i. Each gets its own cache lines.
+struct alignedstat {
+  struct schedstat st;
+} __attribute__((aligned(CACHELINE)));
+static struct alignedstat pstat[NPROC];
+static struct alignedstat cstat[NCPU];
 
 extern void forkret(void);
+static void kthreadstart(void);
+static void threadexit(struct proc *p, int status) __attribute__((noreturn));
+static void killthreads(struct proc *p);
 static void freeproc(struct proc *p);
+static void freeuser(struct proc *p);
+static void account(struct proc *p);
+static void setrunnable(struct proc *p);
+static void statwait(struct proc *p, struct cpu *c, uint64 cycles);
+static void statswitch(struct proc *p, struct cpu *c, uint64 cycles);
+static void dispatch(struct cpu *c, struct proc *p);
+static void finishswitch(void);
 
 extern char trampoline[]; // trampoline.S
 
@@ -26,6 +79,14 @@ extern char trampoline[]; // trampoline.S
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
+// The current MLFQ boost epoch, one per BOOSTTICKS ticks
+// since boot; see priboost().
+static uint
+boostepoch(void)
+{
+  return uptimeticks() / BOOSTTICKS;
+}
+
 // Allocate a page for each process's kernel stack.
 // Map it high in memory, followed by an invalid
 // guard page.
@@ -48,14 +109,21 @@ void
 procinit(void)
 {
   struct proc *p;
+  struct cpu *c;
   
-  initlock(&pid_lock, "nextpid");
+  initrwlock(&pid_lock, "pid");
   initlock(&wait_lock, "wait_lock");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
+      initlock(&p->glock, "group");
       p->state = UNUSED;
       p->kstack = KSTACK((int) (p - proc));
+      p->rq_cpu = -1;
   }
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    runqinit(&c->rq);
+  for(int i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
 }
 
 // Must be called with interrupts disabled,
@@ -89,28 +157,103 @@ myproc(void)
   return p;
 }
 
+// Add p to the pid hash.
+// Caller must hold p->lock.
+static void
+pidhashput(struct proc *p)
+{
+  struct proc **pp = &pidhash[p->pid % NPIDHASH];
+
+  acquirewrite(&pid_lock);
+  p->pid_next = *pp;
+  *pp = p;
+  releasewrite(&pid_lock);
+}
+
+// Remove p from the pid hash.
+// Caller must hold p->lock.
+static void
+pidhashdel(struct proc *p)
+{
+  struct proc **pp;
+
+  acquirewrite(&pid_lock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pid_next){
+    if(*pp == p){
+      *pp = p->pid_next;
+      break;
+    }
+  }
+  p->pid_next = 0;
+  releasewrite(&pid_lock);
+}
+
+// Find the process with the given pid, or 0.
+// The result may be freed and reused as soon as pid_lock
+// is released, so the caller must re-check p->pid once it
+// holds p->lock.
+static struct proc*
+pidlookup(int pid)
+{
+  struct proc *p;
+
+  acquireread(&pid_lock);
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pid_next)
+    if(p->pid == pid)
+      break;
+  releaseread(&pid_lock);
+  return p;
+}
+
+// Push p onto a child list (a parent's children or zombies).
+// Caller must hold wait_lock.
+static void
+sibpush(struct proc **head, struct proc *p)
+{
+  p->sib_prev = 0;
+  p->sib_next = *head;
+  if(*head)
+    (*head)->sib_prev = p;
+  *head = p;
+}
+
+// Remove p from the child list it is on.
+// Caller must hold wait_lock.
+static void
+sibunlink(struct proc **head, struct proc *p)
+{
+  if(p->sib_prev)
+    p->sib_prev->sib_next = p->sib_next;
+  else
+    *head = p->sib_next;
+  if(p->sib_next)
+    p->sib_next->sib_prev = p->sib_prev;
+  p->sib_next = p->sib_prev = 0;
+}
+
 int
 allocpid()
 {
-  int pid;
-  
-  acquire(&pid_lock);
-  pid = nextpid;
-  nextpid = nextpid + 1;
-  release(&pid_lock);
-
-  return pid;
+  return __atomic_fetch_add(&nextpid, 1, __ATOMIC_RELAXED);
 }
 
+// Kinds of struct proc, for allocproc().
+#define PROC_USER    0  // a process: trapframe and its own page table
+#define PROC_THREAD  1  // a thread: trapframe; shares its leader's page table
+#define PROC_KTHREAD 2  // a kernel thread: neither
+
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// If there are no free procs, or a memory allocation fails, return 0;
+// in the latter case set *nomem if nomem isn't 0.
 static struct proc*
-allocproc(void)
+allocproc(int kind, int *nomem)
 {
   struct proc *p;
 
+  if(nomem)
+    *nomem = 0;
   for(p = proc; p < &proc[NPROC]; p++) {
     acquire(&p->lock);
     if(p->state == UNUSED) {
@@ -124,26 +267,51 @@ allocproc(void)
 found:
   p->pid = allocpid();
   p->state = USED;
+  pidhashput(p);
 
   p->nice = 1;
   p->priority = 3 - p->nice; 
+  p->slice = 0;
+  p->policy = SCHED_MLFQ;
+  p->rtprio = 0;
+  p->vruntime = 0;
+  p->cpu = -1;
+  p->affinity = -1;
+  p->nmigrations = 0;
+  p->inherit = -1;
+  p->pigen = 0;
+  p->boostepoch = boostepoch();
+  p->sleeplocks = 0;
+  memset(&pstat[p - proc], 0, sizeof(pstat[0]));
 
   p->mmap = 0;
   p->mmap_pages = 0;
-
-  // Allocate a trapframe page.
-  if((p->trapframe = (struct trapframe *)kalloc()) == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
+  p->kthread = kind == PROC_KTHREAD;
+  p->leader = p;
+  p->tslot = 0;
+  p->tslots = 1;
+
+  if(kind != PROC_KTHREAD){
+    // Allocate a trapframe page.
+    if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+      freeproc(p);
+      release(&p->lock);
+      if(nomem)
+        *nomem = 1;
+      return 0;
+    }
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
+  if(kind == PROC_USER){
+    // An empty user page table.
+    p->pagetable = proc_pagetable(p);
+    if(p->pagetable == 0){
+      freeproc(p);
+      release(&p->lock);
+      if(nomem)
+        *nomem = 1;
+      return 0;
+    }
   }
 
   // Set up new context to start executing at forkret,
@@ -161,9 +329,42 @@ found:
 static void
 freeproc(struct proc *p)
 {
+  if(p->leader != p){
+    // a thread: the page table is the leader's, so only
+    // take this thread's trapframe out of it.
+    if(p->tslot > 0){
+      acquire(&p->leader->glock);
+      uvmunmap(p->pagetable, THREADFRAME(p->tslot), 1, 0);
+      release(&p->leader->glock);
+    }
+    p->pagetable = 0;
+    p->leader = p;
+    p->tslot = 0;
+  }
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
+  freeuser(p);
+  if(p->pid)
+    pidhashdel(p);
+  p->pid = 0;
+  p->parent = 0;
+  p->name[0] = 0;
+  p->chan = 0;
+  p->killed = 0;
+  p->xstate = 0;
+  p->tracing = 0;
+  p->kthread = 0;
+  p->kfn = 0;
+  p->karg = 0;
+  p->state = UNUSED;
+}
+
+// Free p's user memory and page table, if it still has them.
+// A thread only borrows its leader's.
+static void
+freeuser(struct proc *p)
+{
   if (p->pagetable) {
   	if (p->mmap_pages > 0) {
   		uvmunmap(p->pagetable, p->mmap, p->mmap_pages, 1);
@@ -175,14 +376,6 @@ freeproc(struct proc *p)
     
   p->pagetable = 0;
   p->sz = 0;
-  p->pid = 0;
-  p->parent = 0;
-  p->name[0] = 0;
-  p->chan = 0;
-  p->killed = 0;
-  p->xstate = 0;
-  p->tracing = 0;
-  p->state = UNUSED;
 }
 
 // Create a user page table for a given process, with no user memory,
@@ -235,34 +428,77 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(PROC_USER, 0);
   initproc = p;
   
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
-// Shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
-int
-growproc(int n)
+// Grow or shrink user memory by n bytes. If lazy, only
+// move the break on growth and let vmfault() allocate the
+// pages. Threads share memory through their group leader,
+// so this happens under its group lock.
+// Return the old size on success, -1 on failure.
+uint64
+growproc(int n, int lazy)
 {
-  uint64 sz;
-  struct proc *p = myproc();
-
-  sz = p->sz;
-  if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
-      return -1;
+  uint64 sz, oldsz, end, next;
+  struct proc *g = myproc()->leader;
+  int tries = 0;
+
+ again:
+  acquire(&g->glock);
+  sz = oldsz = g->sz;
+  end = sz + n;
+  if(n > 0 && end < sz)
+    goto bad;
+  if(n > 0 && lazy){
+    sz = end;
+  } else if(n > 0){
+    // COPYBATCH pages at a time, dropping the group lock in
+    // between to reschedule if need be. g->sz covers each
+    // batch before the lock is dropped, so that the other
+    // threads may use it; if one of them moves the break
+    // meanwhile, give up and leave the memory to it.
+    while(sz < end){
+      next = PGROUNDUP(sz) + COPYBATCH*PGSIZE;
+      if(next > end)
+        next = end;
+      if((next = uvmalloc(g->pagetable, sz, next, PTE_W)) == 0){
+        g->sz = uvmdeallocshared(g->pagetable, sz, oldsz);
+        // memory held by exited processes may be about to
+        // come free.
+        release(&g->glock);
+        if(tries++ < RECLAIMTRIES && reclaimwait())
+          goto again;
+        return -1;
+      }
+      g->sz = sz = next;
+      if(condresched(&g->glock) && g->sz != sz)
+        goto bad;
     }
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    // likewise COPYBATCH pages at a time; end wraps around
+    // past zero if n is larger than the size, which leaves
+    // nothing to free.
+    while(sz > end){
+      next = sz - end > COPYBATCH*PGSIZE ? sz - COPYBATCH*PGSIZE : end;
+      g->sz = sz = uvmdeallocshared(g->pagetable, sz, next);
+      if(condresched(&g->glock) && g->sz != sz)
+        goto bad;
+    }
   }
-  p->sz = sz;
-  return 0;
+  g->sz = sz;
+  release(&g->glock);
+  return oldsz;
+
+ bad:
+  release(&g->glock);
+  return -1;
 }
 
 // Create a new process, copying the parent.
@@ -270,22 +506,37 @@ growproc(int n)
 int
 kfork(void)
 {
-  int i, pid;
+  int i, pid, nomem, tries = 0;
   struct proc *np;
   struct proc *p = myproc();
-
-  // Allocate process.
-  if((np = allocproc()) == 0){
+  struct proc *g = p->leader;
+
+  // Allocate process. Waiting for the reclaimer can
+  // help if memory ran out, but not if slots did.
+ again:
+  if((np = allocproc(PROC_USER, &nomem)) == 0){
+    if(nomem && tries++ < RECLAIMTRIES && reclaimwait())
+      goto again;
     return -1;
   }
+  // np is USED, so nothing will run it or free it; don't
+  // keep interrupts off for the copy by holding its lock.
+  release(&np->lock);
 
-  // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // Copy user memory from parent to child. In a threaded
+  // parent, hold the group lock so that other threads
+  // can't change the memory or files in the meantime;
+  // uvmcopy() drops it to reschedule if need be.
+  acquire(&g->glock);
+  if((np->sz = uvmcopy(p->pagetable, np->pagetable, &g->sz, &g->glock)) == -1){
+    release(&g->glock);
+    acquire(&np->lock);
     freeproc(np);
     release(&np->lock);
+    if(tries++ < RECLAIMTRIES && reclaimwait())
+      goto again;
     return -1;
   }
-  np->sz = p->sz;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -293,11 +544,11 @@ kfork(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
-  np->mmap = p->mmap;
-  np->mmap_pages = p->mmap_pages;
+  np->mmap = g->mmap;
+  np->mmap_pages = g->mmap_pages;
 
-  for (i = 0; i < p->mmap_pages; i++) {
-  	uint64 va = p->mmap + (uint64)i * PGSIZE;
+  for (i = 0; i < g->mmap_pages; i++) {
+  	uint64 va = g->mmap + (uint64)i * PGSIZE;
 
   	uint64 pa = walkaddr(p->pagetable, va);
   	if (pa == 0)
@@ -314,14 +565,23 @@ kfork(void)
 
   // increment reference counts on open file descriptors.
   for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+    if(g->ofile[i])
+      np->ofile[i] = filedup(g->ofile[i]);
+  np->cwd = idup(g->cwd);
+  release(&g->glock);
 
+  acquire(&np->lock);
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   np->nice = p->nice; // copy parent's nicenessœ
   np->priority = p->priority;
+
+  // a fair child starts one granule behind its parent,
+  // so that forking doesn't buy extra CPU time.
+  np->policy = p->policy;
+  np->rtprio = p->rtprio;
+  np->vruntime = p->vruntime + FAIRGRAN;
+  np->affinity = p->affinity;
   
   pid = np->pid;
 
@@ -329,15 +589,87 @@ kfork(void)
 
   acquire(&wait_lock);
   np->parent = p;
+  sibpush(&p->children, np);
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Start a kernel thread running fn(arg), with its own
+// kernel stack but no user memory, files or directory.
+// It is scheduled like any process. It has no parent until
+// it exits with kthreadexit() (or returns from fn), when
+// init reaps it. Returns its pid, or -1.
+int
+kthreadcreate(void (*fn)(void*), void *arg, char *name)
+{
+  struct proc *p;
+  int pid;
+
+  if((p = allocproc(PROC_KTHREAD, 0)) == 0)
+    return -1;
+  p->kfn = fn;
+  p->karg = arg;
+  p->context.ra = (uint64)kthreadstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+  pid = p->pid;
+  setrunnable(p);
+  release(&p->lock);
+  return pid;
+}
+
+// A kernel thread's very first scheduling by scheduler()
+// will swtch here.
+static void
+kthreadstart(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler() or sched().
+  finishswitch();
+  release(&p->lock);
+
+  // the intena restored by that release belongs to whoever
+  // switched here (scheduler() runs with interrupts off),
+  // so turn them on for the thread.
+  intr_on();
+
+  p->kfn(p->karg);
+  kthreadexit();
+}
+
+// Exit the current kernel thread. Does not return.
+// It stays a zombie until init's wait() frees it.
+void
+kthreadexit(void)
+{
+  struct proc *p = myproc();
+
+  if(!p->kthread)
+    panic("kthreadexit");
+  if(initproc == 0)
+    panic("kthreadexit before init");
+
+  acquire(&wait_lock);
+  p->parent = initproc;
+  sibpush(&initproc->zombies, p);
+  wakeup(initproc);
+
+  acquire(&p->lock);
+  p->xstate = 0;
+  p->state = ZOMBIE;
+
+  release(&wait_lock);
+
+  // Jump into the scheduler, never to return.
+  sched();
+  panic("zombie exit");
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -345,11 +677,187 @@ reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
+  while((pp = p->children) != 0){
+    sibunlink(&p->children, pp);
+    pp->parent = initproc;
+    sibpush(&initproc->children, pp);
+  }
+  if(p->zombies){
+    while((pp = p->zombies) != 0){
+      sibunlink(&p->zombies, pp);
       pp->parent = initproc;
-      wakeup(initproc);
+      sibpush(&initproc->zombies, pp);
     }
+    wakeup(initproc);
+  }
+}
+
+// Exit thread p, which is not its group's leader.
+// Does not return. It stays a zombie until join() frees it.
+static void
+threadexit(struct proc *p, int status)
+{
+  struct proc *g = p->leader;
+
+  acquire(&wait_lock);
+
+  // Give any children to init.
+  reparent(p);
+
+  sibunlink(&g->threads, p);
+  sibpush(&g->tzombies, p);
+
+  // A thread, or the exiting leader, might be
+  // sleeping in join() or killthreads().
+  wakeup(g);
+
+  acquire(&p->lock);
+
+  p->xstate = status;
+  p->state = ZOMBIE;
+
+  release(&wait_lock);
+
+  // Jump into the scheduler, never to return.
+  sched();
+  panic("zombie exit");
+}
+
+// Free thread t, a zombie.
+// Caller must hold wait_lock.
+static void
+threadfree(struct proc *t)
+{
+  struct proc *g = t->leader;
+
+  acquire(&t->lock);
+  sibunlink(&g->tzombies, t);
+  g->tslots &= ~(1UL << t->tslot);
+  freeproc(t);
+  release(&t->lock);
+}
+
+// Kill all the other threads of leader p, and wait for
+// them to exit.
+static void
+killthreads(struct proc *p)
+{
+  struct proc *t;
+
+  acquire(&wait_lock);
+  for(t = p->threads; t; t = t->sib_next)
+    kkill(t->pid);
+  for(;;){
+    while(p->tzombies)
+      threadfree(p->tzombies);
+    if(p->threads == 0)
+      break;
+    sleep(p, &wait_lock);
+  }
+  release(&wait_lock);
+}
+
+// Create a new thread in the current process, sharing its
+// memory, open files and directory, that starts by calling
+// fn(arg) on the user stack whose top is stack. fn must
+// not return; the thread ends by calling exit().
+// Returns the new thread's id (a pid), or -1.
+int
+kclone(uint64 fn, uint64 arg, uint64 stack)
+{
+  struct proc *np;
+  struct proc *p = myproc();
+  struct proc *g = p->leader;
+  int slot, tid;
+
+  if((np = allocproc(PROC_THREAD, 0)) == 0)
+    return -1;
+
+  np->leader = g;
+  np->pagetable = p->pagetable;
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack & ~0xfUL;  // riscv sp must be 16-byte aligned
+  np->trapframe->ra = 0;
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  np->nice = p->nice;
+  np->priority = p->priority;
+  np->policy = p->policy;
+  np->rtprio = p->rtprio;
+  np->vruntime = p->vruntime + FAIRGRAN;
+  np->affinity = p->affinity;
+  tid = np->pid;
+
+  release(&np->lock);
+
+  // find a free trapframe slot, and map np's trapframe
+  // there in the shared page table. If the leader is
+  // exiting, killthreads() has already killed p, and
+  // won't know about np.
+  acquire(&wait_lock);
+  for(slot = 1; slot < NTHREAD; slot++)
+    if((g->tslots & (1UL << slot)) == 0)
+      break;
+  if(slot == NTHREAD || killed(p))
+    goto bad;
+  acquire(&g->glock);
+  if(mappages(g->pagetable, THREADFRAME(slot), PGSIZE,
+              (uint64)np->trapframe, PTE_R | PTE_W) < 0){
+    release(&g->glock);
+    goto bad;
+  }
+  release(&g->glock);
+  np->tslot = slot;
+  g->tslots |= 1UL << slot;
+  sibpush(&g->threads, np);
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  setrunnable(np);
+  release(&np->lock);
+
+  return tid;
+
+ bad:
+  release(&wait_lock);
+  acquire(&np->lock);
+  freeproc(np);
+  release(&np->lock);
+  return -1;
+}
+
+// Wait for thread tid of the current process (any thread,
+// if tid is 0) to exit, and free it. Returns its id, or -1
+// if there is no such thread.
+int
+kjoin(int tid)
+{
+  struct proc *t;
+  struct proc *p = myproc();
+  struct proc *g = p->leader;
+
+  acquire(&wait_lock);
+  for(;;){
+    for(t = g->tzombies; t; t = t->sib_next){
+      if(tid == 0 || t->pid == tid){
+        tid = t->pid;
+        threadfree(t);
+        release(&wait_lock);
+        return tid;
+      }
+    }
+
+    for(t = g->threads; t; t = t->sib_next)
+      if(t != p && (tid == 0 || t->pid == tid))
+        break;
+    if(t == 0 || killed(p)){
+      release(&wait_lock);
+      return -1;
+    }
+
+    // threadexit() wakes up the leader.
+    sleep(g, &wait_lock);
   }
 }
 
@@ -364,6 +872,14 @@ kexit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  if(p->leader != p)
+    threadexit(p, status);
+
+  // The other threads share the address space and files
+  // about to be freed; stop them first.
+  if(p->threads || p->tzombies)
+    killthreads(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -378,11 +894,21 @@ kexit(int status)
   end_op();
   p->cwd = 0;
 
+  // Leave user memory to the reclaimer, rather than freeing
+  // it in the parent's wait() with wait_lock and p->lock held.
+  // Nothing else uses it: the other threads are gone, and p
+  // won't return to user space.
+  reclaim(p);
+
   acquire(&wait_lock);
 
   // Give any children to init.
   reparent(p);
 
+  // Let the parent's wait() find p without a search.
+  sibunlink(&p->parent->children, p);
+  sibpush(&p->parent->zombies, p);
+
   // Parent might be sleeping in wait().
   wakeup(p->parent);
   
@@ -403,99 +929,51 @@ kexit(int status)
 int
 kwait(uint64 addr)
 {
-  struct proc *pp;
-  int havekids, pid;
-  struct proc *p = myproc();
-
-  acquire(&wait_lock);
-
-  for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
-        release(&pp->lock);
-      }
-    }
-
-    // No point waiting if we don't have any children.
-    if(!havekids || killed(p)){
-      release(&wait_lock);
-      return -1;
-    }
-    
-    // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
-  }
+  return kwait2(addr, 0);
 }
 
-// Wait for a child process to exit and return its pid.
+// Wait for a child process to exit and return its pid,
+// also copying out its system call count if addr2 != 0.
 // Return -1 if this process has no children.
 int
 kwait2(uint64 addr, uint64 addr2)
 {
   struct proc *pp;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-
-		  // copy syscall count to user
-		  if(addr2 != 0 && copyout(p->pagetable, addr2, (char *)&pp->counter,
-		                                    sizeof(pp->counter)) < 0) {
-		              release(&pp->lock);
-		              release(&wait_lock);
-		              return -1;
-		            }
-          
-          freeproc(pp);
-          release(&pp->lock);
-          release(&wait_lock);
-          return pid;
-        }
+    if((pp = p->zombies) != 0){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      pid = pp->pid;
+      if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                              sizeof(pp->xstate)) < 0) {
+        release(&pp->lock);
+        release(&wait_lock);
+        return -1;
+      }
+
+      // copy syscall count to user
+      if(addr2 != 0 && copyout(p->pagetable, addr2, (char *)&pp->counter,
+                               sizeof(pp->counter)) < 0) {
         release(&pp->lock);
+        release(&wait_lock);
+        return -1;
       }
+
+      sibunlink(&p->zombies, pp);
+      freeproc(pp);
+      release(&pp->lock);
+      release(&wait_lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || killed(p)){
+    if(p->children == 0 || killed(p)){
       release(&wait_lock);
       return -1;
     }
@@ -519,66 +997,104 @@ scheduler(void)
   struct cpu *c = mycpu();
 
   c->proc = 0;
+  __sync_fetch_and_or(&cpusonline, 1UL << cpuid());
   for(;;){
-  // The most recent process to run may have had interrupts
-  // turned off; enable them to avoid a deadlock if all
-  // processes are waiting. Then turn them back off
-  // to avoid a possible race between an interrupt
-  // and wfi.
-  intr_on();
-  intr_off();
-
-  int found = 0;
+    // The most recent process to run may have had interrupts
+    // turned off; enable them to avoid a deadlock if all
+    // processes are waiting. Then turn them back off
+    // to avoid a possible race between an interrupt
+    // and wfi.
+    intr_on();
+    intr_off();
+
+    // Run the process sched() picked, if any, else the
+    // highest-priority process on this CPU's queue; if
+    // there is none, steal one from a busier CPU.
+    if((p = c->next) != 0)
+      c->next = 0;
+    else if((p = runqget(c)) == 0 && (p = runqsteal(c)) == 0){
+      // nothing to run. say so before looking once more:
+      // a runqput() that the second look misses will see
+      // c->idle and send an IPI, which keeps wfi from
+      // sleeping through it.
+      if(!c->idle){
+        c->idle = 1;
+        __sync_synchronize();
+        continue;
+      }
+      // stop running on this core until an interrupt.
+      // clockintr() stops the periodic tick on an idle CPU,
+      // so this waits for an IPI, a device or a timer.
+      asm volatile("wfi");
+      continue;
+    }
+    if(c->idle){
+      // restart the tick, to time p's slice.
+      c->idle = 0;
+      c->nexttick = r_time() + TICKCYCLES;
+      timerarm();
+    }
 
-  // Find the highest priority among RUNNABLE processes
-  // so we can start scanning from there
-  int max_priority = -1;
-  for(p = proc; p < &proc[NPROC]; p++){
+    // p is off every run queue, so no other CPU can pick it,
+    // but its previous CPU may still be switching away from
+    // it; acquiring p->lock waits for that to finish.
     acquire(&p->lock);
-    if(p->state == RUNNABLE && p->priority > max_priority)
-      max_priority = p->priority;
+    dispatch(c, p);
+
+    // Switch to chosen process. It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    // It may have switched directly to others (see sched()),
+    // so the one coming back is c->proc, not necessarily p.
+    p = c->proc;
+    c->proc = 0;
     release(&p->lock);
   }
+}
 
-  // Iterate priority "levels" from highest we observed down to 0.
-  // At each level, run any RUNNABLE process whose priority is >= level.
-  if(max_priority >= 0){
-    for(int level = max_priority; level >= 0; level--){
-      int found_runnable = 0;
-
-      for(p = proc; p < &proc[NPROC]; p++){
-        acquire(&p->lock);
-        if(p->state == RUNNABLE && p->priority >= level){
-          found_runnable = 1;
-
-          // Switch to chosen process. It is the process's job
-          // to release its lock and then reacquire it
-          // before jumping back to us.
-          p->state = RUNNING;
-          c->proc = p;
-          swtch(&c->context, &p->context);
-
-          // Process is done running for now.
-          // It should have changed its p->state before coming back.
-          c->proc = 0;
-          found = 1;
-        }
-        release(&p->lock);
-      }
-
-      // If no process qualified at this level, just drop to the next one.
-      if(!found_runnable)
-        continue;
-    }
+// Make p, which was taken off the run queues, the process
+// running on c.
+// Caller must hold p->lock.
+static void
+dispatch(struct cpu *c, struct proc *p)
+{
+  if(p->state != RUNNABLE)
+    panic("dispatch: not runnable");
+  if(p->cpu >= 0 && p->cpu != cpuid()){
+    runqmigrate(p, c);
+    p->nmigrations++;
   }
+  p->state = RUNNING;
+  p->cpu = cpuid();
+  c->needresched = 0;
+  p->runstart = r_time();
+  p->dispatchedat = p->runstart;
+  statwait(p, c, p->runstart - p->queuedat);
+  c->proc = p;
+}
 
-  if(found == 0){
-    // nothing to run; stop running on this core until an interrupt.
-    asm volatile("wfi");
+// Called by a process that another process switched to
+// directly, as soon as it is running: release the lock of
+// the one that switched away, which sched() had to keep
+// holding until it was off its stack.
+static void
+finishswitch(void)
+{
+  struct cpu *c = mycpu();
+  struct proc *prev = c->prev;
+
+  if(prev){
+    c->prev = 0;
+    release(&prev->lock);
   }
- }
-} 
-// Switch to scheduler.  Must hold only p->lock
+}
+
+// Switch to the next process on this CPU's queue, or to
+// scheduler() if there isn't one.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -590,6 +1106,8 @@ sched(void)
 {
   int intena;
   struct proc *p = myproc();
+  struct proc *np;
+  struct cpu *c = mycpu();
 
   if(!holding(&p->lock))
     panic("sched p->lock");
@@ -600,9 +1118,270 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
-  intena = mycpu()->intena;
-  swtch(&p->context, &mycpu()->context);
+  // charge the time used, then queue p again if it
+  // is only yielding. another CPU may take it off the
+  // queue right away, but has to wait for p->lock,
+  // which the scheduler releases once p is switched out.
+  account(p);
+  statswitch(p, c, p->runstart - p->dispatchedat);
+  if(p->state == RUNNABLE){
+    p->queuedat = p->runstart;
+    runqput(p);
+  }
+
+  // Fast path: switch straight to the next process on this
+  // CPU's queue, saving a trip through scheduler() and its
+  // second register save and restore. If p is yielding and
+  // still comes first, keep running it.
+  if((np = runqget(c)) == p){
+    dispatch(c, p);
+    return;
+  }
+  if(np){
+    // np's lock may be held by a CPU that is waiting for
+    // p->lock, so don't spin for it; let scheduler(),
+    // which holds no lock, take np instead.
+    if(!tryacquire(&np->lock)){
+      c->next = np;
+    } else {
+      dispatch(c, np);
+      pstat[np - proc].st.ndirect++;
+      cstat[c - cpus].st.ndirect++;
+      c->prev = p;
+      intena = c->intena;
+      swtch(&p->context, &np->context);
+      mycpu()->intena = intena;
+      finishswitch();
+      return;
+    }
+  }
+
+  intena = c->intena;
+  swtch(&p->context, &c->context);
   mycpu()->intena = intena;
+  finishswitch();
+}
+
+// Make p RUNNABLE and queue it, noting the time so that
+// the scheduler can measure how long it waits.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  p->queuedat = r_time();
+  runqput(p);
+}
+
+// Add a time, in cycles, to histogram h and its total.
+static void
+histadd(uint64 *h, uint64 *total, uint64 cycles)
+{
+  uint64 us = cycles / (TIMEBASE/1000000);
+  int i = 0;
+
+  while(i < NSCHEDHIST-1 && (us >> (i+1)) != 0)
+    i++;
+  h[i]++;
+  *total += us;
+}
+
+// Record that p waited on a run queue for the given number
+// of cycles before starting to run on c.
+// Caller must hold p->lock.
+static void
+statwait(struct proc *p, struct cpu *c, uint64 cycles)
+{
+  struct schedstat *ps = &pstat[p - proc].st;
+  struct schedstat *cs = &cstat[c - cpus].st;
+
+  histadd(ps->wait, &ps->waittime, cycles);
+  histadd(cs->wait, &cs->waittime, cycles);
+}
+
+// Record that p, about to switch away from c, ran for the
+// given number of cycles, and whether it was preempted.
+// Caller must hold p->lock.
+static void
+statswitch(struct proc *p, struct cpu *c, uint64 cycles)
+{
+  struct schedstat *ps = &pstat[p - proc].st;
+  struct schedstat *cs = &cstat[c - cpus].st;
+
+  histadd(ps->slice, &ps->runtime, cycles);
+  histadd(cs->slice, &cs->runtime, cycles);
+  if(p->state == RUNNABLE){
+    ps->nivcsw++;
+    cs->nivcsw++;
+  } else {
+    ps->nvcsw++;
+    cs->nvcsw++;
+  }
+}
+
+// Charge p for the CPU time it has used since it was last
+// charged. For a fair process, this advances its virtual
+// runtime in inverse proportion to its weight; a real-time
+// process uses up its CPU's real-time budget.
+// Caller must hold p->lock.
+static void
+account(struct proc *p)
+{
+  uint64 now = r_time();
+  uint64 delta = now - p->runstart;
+
+  p->runstart = now;
+  if(p->policy == SCHED_FAIR)
+    p->vruntime += delta * fairweight[0] / fairweight[p->nice];
+  else if(RTPOLICY(p->policy))
+    runqrtcharge(mycpu(), delta);
+  else
+    runqmlfqcharge(mycpu(), delta);
+}
+
+static void boostrunq(struct cpu *c);
+
+// Charge the current process for one clock tick.
+// A SCHED_RR process runs for RRTICKS at a time; a
+// SCHED_FIFO one until something outranks it.
+// An MLFQ process that uses up the quantum of its level is
+// demoted one level (it's a CPU hog); the quantum is
+// counted across sleeps so it can't be dodged by
+// sleeping just before it runs out.
+// A fair process is charged for its CPU time instead.
+// Returns 1 if the process should give up the CPU, either
+// because its quantum ran out or because a process that
+// should run first is waiting on this CPU.
+int
+schedtick(void)
+{
+  struct proc *p = myproc();
+  struct cpu *c = mycpu();
+  uint epoch = boostepoch();
+  int resched;
+
+  if(c->boostepoch != epoch){
+    c->boostepoch = epoch;
+    boostrunq(c);
+  }
+
+  acquire(&p->lock);
+  priboost(p);
+  if(RTPOLICY(p->policy)){
+    account(p);
+    resched = runqpreempt(mycpu(), p);
+    if(p->policy == SCHED_RR && ++p->slice >= RRTICKS){
+      // to the back of its list.
+      p->slice = 0;
+      resched = 1;
+    }
+  } else if(p->policy == SCHED_FAIR){
+    account(p);
+    resched = runqpreempt(mycpu(), p);
+  } else {
+    account(p);
+    p->slice++;
+    resched = p->slice >= quantum[p->priority];
+    if(resched){
+      if(p->priority > 0)
+        p->priority--;
+      p->slice = 0;
+    } else {
+      resched = runqpreempt(mycpu(), p);
+    }
+  }
+  // p's affinity may have changed to exclude this CPU.
+  if((p->affinity & (1UL << cpuid())) == 0)
+    resched = 1;
+  release(&p->lock);
+  return resched;
+}
+
+// Periodic MLFQ priority boost: move every process back to
+// the level its nice value entitles it to, so that demoted
+// CPU hogs can't be starved forever by interactive ones.
+// Nothing does this every BOOSTTICKS ticks; instead each
+// process catches up here, under its own lock, when it is
+// next queued or charged a tick. Returns 1 if
+// p's level changed; if p is queued, the caller must
+// requeue it.
+// Caller must hold p->lock.
+int
+priboost(struct proc *p)
+{
+  uint epoch = boostepoch();
+
+  if(p->boostepoch == epoch)
+    return 0;
+  p->boostepoch = epoch;
+  if(p->policy != SCHED_MLFQ)
+    return 0;
+  p->slice = 0;
+  if(p->priority == 3 - p->nice)
+    return 0;
+  p->priority = 3 - p->nice;
+  return 1;
+}
+
+// A process waiting on a run queue isn't queued again or
+// charged ticks until it runs, which a starved one never
+// does; so once per boost epoch each CPU catches up the
+// processes waiting on its own queue.
+static void
+boostrunq(struct cpu *c)
+{
+  struct proc *p;
+
+  while((p = runqstale(&c->rq, c->boostepoch)) != 0){
+    acquire(&p->lock);
+    // requeue at the new level, if it's still queued.
+    if(priboost(p) && runqremove(p))
+      runqput(p);
+    release(&p->lock);
+  }
+}
+
+// A preemption point for long kernel loops. If an interrupt
+// is pending or something should run before the current
+// process, let it: release lk (if not 0), which the caller
+// holds, yield, and take lk again. Returns 1 if it did, in
+// which case whatever lk protects may have changed. Does
+// nothing if the caller holds any other spinlock.
+int
+condresched(struct spinlock *lk)
+{
+  int pending;
+
+  push_off();
+  pending = myproc() != 0 && mycpu()->noff == (lk ? 2 : 1) &&
+            ((r_sip() & r_sie()) != 0 || mycpu()->needresched);
+  pop_off();
+  if(!pending)
+    return 0;
+
+  // releasing lk turns interrupts back on, and a pending
+  // tick may preempt this process in kerneltrap().
+  if(lk)
+    release(lk);
+  if(needresched())
+    yield();
+  if(lk)
+    acquire(lk);
+  return 1;
+}
+
+// Should the current process give up the CPU at the end of
+// this trap, because runqput() queued a process that should
+// run before it?
+int
+needresched(void)
+{
+  int r;
+
+  push_off();
+  r = mycpu()->needresched;
+  pop_off();
+  return r;
 }
 
 // Give up the CPU for one scheduling round.
@@ -625,7 +1404,8 @@ forkret(void)
   static int first = 1;
   struct proc *p = myproc();
 
-  // Still holding p->lock from scheduler.
+  // Still holding p->lock from scheduler() or sched().
+  finishswitch();
   release(&p->lock);
 
   if (first) {
@@ -653,26 +1433,59 @@ forkret(void)
   ((void (*)(uint64))trampoline_userret)(satp);
 }
 
+static struct waitq*
+waitqfor(void *chan)
+{
+  // Fibonacci hashing: channels are often adjacent
+  // fields of one structure, so mix the low bits.
+  return &waitq[((uint64)chan * 0x9E3779B97F4A7C15ULL) >> 58];
+}
+
+// Remove p from wait queue wq.
+// Caller must hold wq->lock.
+static void
+wqunlink(struct waitq *wq, struct proc *p)
+{
+  if(p->wq_prev)
+    p->wq_prev->wq_next = p->wq_next;
+  else
+    wq->head = p->wq_next;
+  if(p->wq_next)
+    p->wq_next->wq_prev = p->wq_prev;
+  else
+    wq->tail = p->wq_prev;
+  p->wq_next = p->wq_prev = 0;
+}
+
 // Sleep on channel chan, releasing condition lock lk.
 // Re-acquires lk when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct waitq *wq = waitqfor(chan);
   
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
-
-  acquire(&p->lock);  //DOC: sleeplock1
+  // Must acquire the wait queue lock and p->lock in
+  // order to queue p and change p->state, and then
+  // call sched. Once we hold the wait queue lock, we
+  // can be guaranteed that we won't miss any wakeup
+  // (wakeup locks it), so it's okay to release lk.
+
+  acquire(&wq->lock);  //DOC: sleeplock1
+  acquire(&p->lock);
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->wq_next = 0;
+  p->wq_prev = wq->tail;
+  if(wq->tail)
+    wq->tail->wq_next = p;
+  else
+    wq->head = p;
+  wq->tail = p;
+  release(&wq->lock);
 
   sched();
 
@@ -684,22 +1497,51 @@ sleep(void *chan, struct spinlock *lk)
   acquire(lk);
 }
 
+// Wake up the first n processes sleeping on channel chan,
+// or all of them if n is negative. Returns the number woken.
+// Caller should hold the condition lock.
+int
+wakeupn(void *chan, int n)
+{
+  struct waitq *wq = waitqfor(chan);
+  struct proc *p, *next;
+  int woken = 0;
+
+  acquire(&wq->lock);
+  for(p = wq->head; p && woken != n; p = next){
+    next = p->wq_next;
+    // p->chan can't change while p is queued, so
+    // it is safe to look at without p->lock.
+    if(p->chan != chan)
+      continue;
+    wqunlink(wq, p);
+    acquire(&p->lock);
+    if(p->state != SLEEPING)
+      panic("wakeup");
+    setrunnable(p);
+    release(&p->lock);
+    woken++;
+  }
+  release(&wq->lock);
+  return woken;
+}
+
 // Wake up all processes sleeping on channel chan.
 // Caller should hold the condition lock.
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  wakeupn(chan, -1);
+}
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-    }
-  }
+// Wake up the process that has been sleeping longest on
+// channel chan. For waiters on a resource that one wakeup
+// can only satisfy one of, such as log space.
+// Caller should hold the condition lock.
+void
+wakeupone(void *chan)
+{
+  wakeupn(chan, 1);
 }
 
 // Kill the process with the given pid.
@@ -709,21 +1551,36 @@ int
 kkill(int pid)
 {
   struct proc *p;
+  struct waitq *wq;
+  void *chan;
 
-  for(p = proc; p < &proc[NPROC]; p++){
+  if(pid <= 0 || (p = pidlookup(pid)) == 0)
+    return -1;
+
+  acquire(&p->lock);
+  if(p->pid != pid){
+    // p exited and was reused after the lookup.
+    release(&p->lock);
+    return -1;
+  }
+  p->killed = 1;
+  chan = p->state == SLEEPING ? p->chan : 0;
+  release(&p->lock);
+  if(chan){
+    // Wake process from sleep(). The wait queue lock
+    // comes before p->lock, so look again once both
+    // are held.
+    wq = waitqfor(chan);
+    acquire(&wq->lock);
     acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
+    if(p->pid == pid && p->state == SLEEPING && p->chan == chan){
+      wqunlink(wq, p);
+      setrunnable(p);
     }
     release(&p->lock);
+    release(&wq->lock);
   }
-  return -1;
+  return 0;
 }
 
 void
@@ -745,6 +1602,156 @@ killed(struct proc *p)
   return k;
 }
 
+// Find the process with the given pid (0 means the caller)
+// and return it with p->lock held, or return 0.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  if(pid < 0 || (p = pidlookup(pid)) == 0)
+    return 0;
+  acquire(&p->lock);
+  if(p->pid != pid || p->state == UNUSED){
+    release(&p->lock);
+    return 0;
+  }
+  return p;
+}
+
+// Set the scheduling policy of process pid, or of the
+// current process if pid is 0, and for SCHED_FIFO and
+// SCHED_RR its real-time priority, 1 to NRTPRIO (highest).
+// A process that becomes fair starts level with the fair
+// processes on its CPU.
+// Returns 0, or -1 if there is no such process or policy.
+int
+setsched(int pid, int policy, int rtprio)
+{
+  struct proc *p;
+  int queued;
+
+  if(RTPOLICY(policy)){
+    if(rtprio < 1 || rtprio > NRTPRIO)
+      return -1;
+  } else if(policy == SCHED_MLFQ || policy == SCHED_FAIR){
+    rtprio = 0;
+  } else {
+    return -1;
+  }
+  if((p = findproc(pid)) == 0)
+    return -1;
+  queued = runqremove(p);
+  if(p->policy != SCHED_FAIR && policy == SCHED_FAIR)
+    p->vruntime = cpus[p->cpu >= 0 ? p->cpu : cpuid()].rq.minvruntime;
+  p->policy = policy;
+  p->rtprio = rtprio;
+  p->slice = 0;
+  if(queued)
+    runqput(p);
+  release(&p->lock);
+  return 0;
+}
+
+// Return the scheduling policy of process pid (0 for the
+// caller), or -1 if there is no such process. Sets *rtprio
+// to its real-time priority, 0 if it isn't real-time.
+int
+getsched(int pid, int *rtprio)
+{
+  struct proc *p;
+  int policy;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  policy = p->policy;
+  *rtprio = p->rtprio;
+  release(&p->lock);
+  return policy;
+}
+
+// Restrict process pid (0 for the caller) to the CPUs in
+// mask. CPUs that aren't running are ignored; it's an error
+// if none is left. A running process moves at its next
+// tick; the caller of setaffinity() yields to move at once.
+int
+setaffinity(int pid, uint64 mask)
+{
+  struct proc *p;
+
+  mask &= cpusonline;
+  if(mask == 0)
+    return -1;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->affinity = mask;
+  // a queued process may be on the wrong CPU's queue.
+  if(runqremove(p))
+    runqput(p);
+  release(&p->lock);
+  return 0;
+}
+
+// Priority inheritance: p holds a sleep lock that a process
+// of run queue rank r is waiting for. Make p run at rank r
+// or above until it releases its sleep locks, so that lower
+// ranked processes can't keep the waiter waiting.
+void
+piboost(struct proc *p, int r)
+{
+  acquire(&p->lock);
+  if(r > runqrank(p)){
+    p->inherit = r;
+    p->pigen++;
+    pstat[p - proc].st.npiboost++;
+    cstat[cpuid()].st.npiboost++;
+    // a queued process moves to the list for its new rank.
+    if(runqremove(p))
+      runqput(p);
+  }
+  release(&p->lock);
+}
+
+// Copy scheduler statistics to user address addr: those
+// of CPU cpu if cpu >= 0, else those of process pid (0 for
+// the caller). Returns 0, or -1 if there is no such CPU or
+// process.
+int
+schedstat(int pid, int cpu, uint64 addr)
+{
+  struct schedstat st;
+  struct proc *p;
+
+  if(cpu >= 0){
+    if(cpu >= NCPU || (cpusonline & (1UL << cpu)) == 0)
+      return -1;
+    st = cstat[cpu].st;
+  } else {
+    if((p = findproc(pid)) == 0)
+      return -1;
+    st = pstat[p - proc].st;
+    release(&p->lock);
+  }
+  return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+}
+
+// Return the affinity mask of process pid (0 for the
+// caller) in *mask and its migration count in *nmigrations.
+int
+getaffinity(int pid, uint64 *mask, int *nmigrations)
+{
+  struct proc *p;
+
+  if((p = findproc(pid)) == 0)
+    return -1;
+  *mask = p->affinity & cpusonline;
+  *nmigrations = p->nmigrations;
+  release(&p->lock);
+  return 0;
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
@@ -781,6 +1788,12 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
 void
 procdump(void)
 {
+  static char *policies[] = {
+  [SCHED_MLFQ]  "mlfq",
+  [SCHED_FAIR]  "fair",
+  [SCHED_FIFO]  "fifo",
+  [SCHED_RR]    "rr",
+  };
   static char *states[] = {
   [UNUSED]    "unused",
   [USED]      "used",
@@ -790,9 +1803,15 @@ procdump(void)
   [ZOMBIE]    "zombie"
   };
   struct proc *p;
+  struct cpu *c;
   char *state;
 
   printf("\n");
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c->rq.nrunnable > 0 || c->proc)
+      printf("cpu %d: pid %d running, %d runnable\n", (int)(c - cpus),
+             c->proc ? c->proc->pid : 0, c->rq.nrunnable);
+  }
   for(p = proc; p < &proc[NPROC]; p++){
     if(p->state == UNUSED)
       continue;
@@ -800,7 +1819,9 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    printf("%d %s %s priority=%d nice=%d\n", p->pid, state, p->name, p->priority, p->nice);
+    printf("%d %s %s %s rtprio=%d priority=%d nice=%d slice=%d vruntime=%ld cpu=%d affinity=%lx migrations=%d\n",
+           p->pid, state, p->name, policies[p->policy], p->rtprio, p->priority, p->nice,
+           p->slice, p->vruntime, p->cpu, p->affinity & cpusonline, p->nmigrations);
     printf("\n");
   }
 }
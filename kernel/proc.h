@@ -18,15 +18,53 @@ struct context {
   uint64 s11;
 };
 
-// Per-CPU state.
+// Per-CPU queue of RUNNABLE processes: one FIFO list per
+// MLFQ priority level and per real-time priority, plus a
+// heap of fair processes. See runq.c.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO+NRTPRIO]; // Next process to run at each level
+  struct proc *tail[NPRIO+NRTPRIO];
+  struct proc *fair[NPROC];   // Fair processes, a min-heap on vruntime
+  int nfair;
+  uint64 minvruntime;         // Lower bound on queued fair vruntimes
+  int nrunnable;              // Number of queued processes
+  int nrt;                    // Number of queued real-time processes
+
+  // only this CPU updates these, without the lock:
+  uint64 rtstart;             // Start of the real-time throttling period
+  uint64 rtused;              // Real-time CPU time used in the period
+  uint64 mlfqstart;           // Start of the MLFQ throttling period
+  uint64 mlfqused;            // MLFQ CPU time used in the period
+};
+
+// Per-CPU state. Each CPU's has cache lines to itself,
+// and the run queue, which other CPUs lock, starts a line
+// apart from the fields only this CPU writes.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
-};
+  struct runq rq __attribute__((aligned(CACHELINE))); // Processes waiting to run on this cpu.
+  int idle;                   // In scheduler() with nothing to run; tick stopped.
+  uint64 nexttick;            // When the next scheduler tick is due.
+  int needresched;            // Something on rq should preempt proc.
+  struct proc *prev;          // Switched away from directly; lock still held.
+  struct proc *next;          // Taken off rq for scheduler() to run next.
+  uint64 userseq;             // Odd while in user space; see tlbshootdown().
+  uint boostepoch;            // Last MLFQ boost rq has caught up with
+  uint64 offstart;            // When noff became 1 (LATTRACE)
+  uint64 offpc;               // Who made noff 1 (LATTRACE)
+} __attribute__((aligned(CACHELINE)));
+
+// CPU sets are bit masks.
+#if NCPU > 64
+#error "NCPU must be at most 64"
+#endif
 
 extern struct cpu cpus[NCPU];
+extern uint64 cpusonline;     // Bit i is set once CPU i is scheduling.
 
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
@@ -94,22 +132,67 @@ struct proc {
   int tracing;                 // Trace Flag
   int counter;                 // Counter for tracking SYS calls
   int nice;                    // (0 = highest priority) 
-  int priority;                // (derived: prio = 3 - nice; higher number = higher priority)
+  int priority;                // MLFQ level: starts at 3 - nice, lowered for CPU hogs
+  int slice;                   // Ticks used at the current level
+  uint boostepoch;             // Last MLFQ boost p has caught up with
+  int policy;                  // SCHED_MLFQ, SCHED_FAIR, SCHED_FIFO or SCHED_RR
+  int rtprio;                  // Real-time priority, if FIFO or RR
+  uint64 vruntime;             // Weighted CPU time, for SCHED_FAIR
+  uint64 runstart;             // When p last started running or was charged
+  uint64 queuedat;             // When p was last put on a run queue
+  uint64 dispatchedat;         // When p last started running
+  int cpu;                     // CPU p last ran on, or -1
+  uint64 affinity;             // Mask of CPUs p may run on
+  int nmigrations;             // Times p has moved to another CPU
+  int inherit;                 // Run queue rank lent by sleep lock waiters, or -1
+  int pigen;                   // Counts raises of inherit
 
-  // wait_lock must be held when using this:
+  // the run queue lock must be held when using these:
+  struct proc *rq_next;        // Run queue links
+  struct proc *rq_prev;
+  int rq_cpu;                  // CPU whose run queue p is on, or -1
+  int rq_level;                // Priority list p is on, or -1 for the fair heap
+  int rq_idx;                  // Index in the fair heap
+
+  // the wait queue lock for p->chan must be held when using these:
+  struct proc *wq_next;        // Wait queue links
+  struct proc *wq_prev;
+
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *children;       // Live children
+  struct proc *zombies;        // Exited children, not yet waited for
+  struct proc *sib_next;       // Links in parent's children or zombies,
+  struct proc *sib_prev;       //   or for a thread, leader's threads or tzombies
+  struct proc *threads;        // In a leader: its other live threads
+  struct proc *tzombies;       // In a leader: exited threads, not yet joined
+  uint64 tslots;               // In a leader: thread slots in use
+
+  // pid_lock must be held when using this:
+  struct proc *pid_next;       // PID hash chain
+
+  // in a thread group, the leader's glock must be held to change
+  // the leader's sz, mmap, mmap_pages, ofile and cwd, which all of
+  // the group's threads share, or the shared page table.
+  struct spinlock glock;
 
   // these are private to the process, so p->lock need not be held.
+  struct proc *leader;         // Thread group leader; p unless p is a thread
+  int tslot;                   // Thread slot: trapframe at THREADFRAME(tslot)
+  int kthread;                 // Kernel thread: no user memory or files
+  void (*kfn)(void*);          // Kernel thread function and argument
+  void *karg;
+  struct sleeplock *sleeplocks; // Sleep locks held, newest first
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
+  uint64 sz;                   // Size of process memory (bytes), in leader
 
-  uint64 mmap;                 // lowest virtual address used by mmap region
-  int mmap_pages;              // number of mmap pages currently mapped
+  uint64 mmap;                 // lowest virtual address used by mmap region, in leader
+  int mmap_pages;              // number of mmap pages currently mapped, in leader
   
-  pagetable_t pagetable;       // User page table
+  pagetable_t pagetable;       // User page table, shared by a thread group
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct file *ofile[NOFILE];  // Open files, in leader
+  struct inode *cwd;           // Current directory, in leader
   char name[16];               // Process name (debugging)
-};
+} __attribute__((aligned(CACHELINE)));
@@ -0,0 +1,181 @@
+// Background reclaim of user memory.
+//
+// An exiting process hands its page table to the reclaimer,
+// a kernel thread that frees the memory and page-table pages
+// in the background. Neither exit() nor the parent's wait()
+// spends time on it, however big the process was.
+//
+// Memory waiting here is not yet free. An allocation that
+// fails can call reclaimwait() to wait for the reclaimer to
+// catch up, and try again if there was anything to wait for.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "reclaim.h"
+#include "defs.h"
+
+struct reclaim {
+  pagetable_t pagetable;
+  uint64 sz;
+  uint64 mmap;
+  int mmap_pages;
+  struct reclaim *next;
+};
+
+// One record per process slot is always enough, unless the
+// slot exits again before the reclaimer gets to the first;
+// then exit() frees the memory itself.
+static struct {
+  struct spinlock lock;
+  struct reclaim recs[NPROC];
+  struct reclaim *free;
+  struct reclaim *head;
+  struct reclaim **tail;
+  struct reclaimstat st;
+} rc;
+
+static void reclaimer(void *arg);
+
+void
+reclaiminit(void)
+{
+  initlock(&rc.lock, "reclaim");
+  for(int i = 0; i < NPROC; i++){
+    rc.recs[i].next = rc.free;
+    rc.free = &rc.recs[i];
+  }
+  rc.tail = &rc.head;
+  if(kthreadcreate(reclaimer, 0, "reclaim") < 0)
+    panic("reclaiminit");
+}
+
+static uint64
+pages(struct reclaim *r)
+{
+  return PGROUNDUP(r->sz) / PGSIZE + r->mmap_pages;
+}
+
+// Free a user page table and the memory it maps.
+static void
+freeall(struct reclaim *r)
+{
+  if(r->mmap_pages > 0)
+    uvmunmap(r->pagetable, r->mmap, r->mmap_pages, 1);
+  proc_freepagetable(r->pagetable, r->sz);
+}
+
+// Free p's user memory and page table, now or soon.
+// Nothing else may be using them.
+void
+reclaim(struct proc *p)
+{
+  struct reclaim *r, tmp;
+
+  if(p->pagetable == 0)
+    return;
+
+  acquire(&rc.lock);
+  if((r = rc.free) != 0)
+    rc.free = r->next;
+  else
+    r = &tmp;
+  r->pagetable = p->pagetable;
+  r->sz = p->sz;
+  r->mmap = p->mmap;
+  r->mmap_pages = p->mmap_pages;
+  if(r != &tmp){
+    r->next = 0;
+    *rc.tail = r;
+    rc.tail = &r->next;
+    rc.st.npending++;
+    rc.st.pendingpages += pages(r);
+    wakeup(&rc.head);
+  } else {
+    rc.st.ninline++;
+  }
+  release(&rc.lock);
+
+  if(r == &tmp)
+    freeall(r);
+
+  p->pagetable = 0;
+  p->sz = 0;
+  p->mmap = 0;
+  p->mmap_pages = 0;
+}
+
+// The reclaimer. Frees one address space at a time, with
+// no locks held, so that it can be preempted throughout.
+static void
+reclaimer(void *arg)
+{
+  struct reclaim *r;
+
+  acquire(&rc.lock);
+  for(;;){
+    while(rc.head == 0)
+      sleep(&rc.head, &rc.lock);
+    r = rc.head;
+    if((rc.head = r->next) == 0)
+      rc.tail = &rc.head;
+    release(&rc.lock);
+
+    freeall(r);
+
+    acquire(&rc.lock);
+    rc.st.npending--;
+    rc.st.pendingpages -= pages(r);
+    rc.st.nreclaimed++;
+    rc.st.reclaimed += pages(r);
+    r->next = rc.free;
+    rc.free = r;
+    if(rc.st.npending == 0)
+      wakeup(&rc.st);
+  }
+}
+
+// Wait until the reclaimer has freed everything handed to
+// it so far. Returns 1 if there was anything to wait for,
+// in which case an allocation that failed might succeed if
+// tried again, and 0 if not or if the caller was killed
+// while waiting. Does nothing if the caller holds a
+// spinlock, or isn't a process, since it couldn't sleep.
+int
+reclaimwait(void)
+{
+  struct proc *p = myproc();
+  int cansleep;
+
+  push_off();
+  cansleep = p != 0 && mycpu()->noff == 1;
+  pop_off();
+  if(!cansleep)
+    return 0;
+
+  acquire(&rc.lock);
+  if(rc.st.npending == 0){
+    release(&rc.lock);
+    return 0;
+  }
+  rc.st.nwaits++;
+  while(rc.st.npending > 0 && !killed(p))
+    sleep(&rc.st, &rc.lock);
+  release(&rc.lock);
+  return !killed(p);
+}
+
+// Copy the reclaim statistics to user address addr.
+int
+reclaimstat(uint64 addr)
+{
+  struct reclaimstat st;
+
+  acquire(&rc.lock);
+  st = rc.st;
+  release(&rc.lock);
+  return copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st));
+}
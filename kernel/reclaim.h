@@ -0,0 +1,11 @@
+// Background reclaim of exited processes' memory, for
+// reclaimstat(). Sizes are of address spaces, in pages,
+// so they count lazily allocated pages never touched.
+struct reclaimstat {
+  uint64 npending;     // Address spaces waiting to be freed
+  uint64 pendingpages; // Their total size
+  uint64 nreclaimed;   // Address spaces freed in the background
+  uint64 reclaimed;    // Their total size
+  uint64 ninline;      // Freed by exit() itself, for want of a slot
+  uint64 nwaits;       // Times an allocation waited for the reclaimer
+};
@@ -0,0 +1,525 @@
+// Per-CPU run queues.
+//
+// Each CPU keeps its own queue of RUNNABLE processes, so that
+// scheduler() never has to scan the process table. A process is
+// put on a queue when it becomes RUNNABLE (wakeup(), sched(),
+// kfork(), kkill()) and is taken off by the scheduler that is
+// about to run it. A CPU whose own queue is empty steals work
+// from the busiest other CPU.
+//
+// A process only ever goes on the queue of a CPU in its
+// affinity mask, and a thief only steals processes that
+// are allowed to run on it. Idle CPUs sleep until an IPI
+// (see runqput()), so they only steal when woken.
+//
+// A queue has three scheduling classes:
+//  - SCHED_FIFO and SCHED_RR: one FIFO list per real-time
+//    priority. These always run first, unless the CPU has
+//    used up its real-time budget (RTRUNTIME per RTPERIOD)
+//    and something else is waiting.
+//  - SCHED_MLFQ: one FIFO list per MLFQ priority level.
+//  - SCHED_FAIR: a min-heap ordered by virtual runtime, which
+//    advances more slowly for processes with a lower nice value.
+// The real-time lists sit above the MLFQ ones, so both use the
+// same list code; see rank(). MLFQ processes run before fair
+// ones, unless the CPU has used up its MLFQ budget (MLFQRUNTIME
+// per RTPERIOD) while fair ones wait, so that a single MLFQ
+// CPU hog can't starve the fair class. A process holding a sleep lock that a higher-ranked
+// process waits for borrows the waiter's rank (see sleeplock.c),
+// so it may sit on a list above its own class.
+//
+// Lock order: p->lock, then rq->lock. runqget() and runqsteal()
+// return a process without any lock held; the caller acquires
+// p->lock afterwards. That is safe because a process that is off
+// every queue but still RUNNABLE belongs to whoever dequeued it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sched.h"
+#include "defs.h"
+
+#define NLEVEL (NPRIO+NRTPRIO)
+
+void
+runqinit(struct runq *rq)
+{
+  initlock(&rq->lock, "runq");
+  for(int i = 0; i < NLEVEL; i++){
+    rq->head[i] = 0;
+    rq->tail[i] = 0;
+  }
+  rq->nfair = 0;
+  rq->minvruntime = 0;
+  rq->nrunnable = 0;
+  rq->nrt = 0;
+  rq->rtstart = 0;
+  rq->rtused = 0;
+  rq->mlfqstart = 0;
+  rq->mlfqused = 0;
+}
+
+// The list a process waits on: its real-time priority above
+// all the MLFQ levels, or its MLFQ level. -1 for fair
+// processes, which rank below every list. A rank inherited
+// from sleep lock waiters overrides a lower one.
+static int
+rank(struct proc *p)
+{
+  int r;
+
+  if(RTPOLICY(p->policy))
+    r = NPRIO + p->rtprio - 1;
+  else if(p->policy == SCHED_FAIR)
+    r = -1;
+  else
+    r = p->priority;
+  return p->inherit > r ? p->inherit : r;
+}
+
+// rank(), for priority inheritance.
+int
+runqrank(struct proc *p)
+{
+  return rank(p);
+}
+
+// Has this queue's CPU used up its real-time budget for
+// the current period?
+static int
+throttled(struct runq *rq)
+{
+  return rq->rtused >= RTRUNTIME && r_time() - rq->rtstart < RTPERIOD;
+}
+
+// Charge c's real-time budget for delta cycles of
+// real-time work. Called only on c itself.
+void
+runqrtcharge(struct cpu *c, uint64 delta)
+{
+  struct runq *rq = &c->rq;
+  uint64 now = r_time();
+
+  if(now - rq->rtstart >= RTPERIOD){
+    rq->rtstart = now;
+    rq->rtused = 0;
+  }
+  rq->rtused += delta;
+}
+
+// Have fair processes on this queue waited while its CPU
+// used up its MLFQ budget for the current period?
+static int
+fairstarved(struct runq *rq)
+{
+  return rq->nfair > 0 && rq->mlfqused >= MLFQRUNTIME &&
+         r_time() - rq->mlfqstart < RTPERIOD;
+}
+
+// Charge c's MLFQ budget for delta cycles of MLFQ work.
+// Called only on c itself.
+void
+runqmlfqcharge(struct cpu *c, uint64 delta)
+{
+  struct runq *rq = &c->rq;
+  uint64 now = r_time();
+
+  if(now - rq->mlfqstart >= RTPERIOD){
+    rq->mlfqstart = now;
+    rq->mlfqused = 0;
+  }
+  rq->mlfqused += delta;
+}
+
+static void
+heapswap(struct runq *rq, int i, int j)
+{
+  struct proc *t = rq->fair[i];
+
+  rq->fair[i] = rq->fair[j];
+  rq->fair[j] = t;
+  rq->fair[i]->rq_idx = i;
+  rq->fair[j]->rq_idx = j;
+}
+
+static void
+siftup(struct runq *rq, int i)
+{
+  while(i > 0 && rq->fair[i]->vruntime < rq->fair[(i-1)/2]->vruntime){
+    heapswap(rq, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void
+siftdown(struct runq *rq, int i)
+{
+  int l, m;
+
+  for(;;){
+    m = i;
+    l = 2*i + 1;
+    if(l < rq->nfair && rq->fair[l]->vruntime < rq->fair[m]->vruntime)
+      m = l;
+    if(l+1 < rq->nfair && rq->fair[l+1]->vruntime < rq->fair[m]->vruntime)
+      m = l+1;
+    if(m == i)
+      break;
+    heapswap(rq, i, m);
+    i = m;
+  }
+}
+
+// Add p to the queue: the tail of its priority list,
+// or the fair heap.
+// Caller must hold rq->lock.
+static void
+rqappend(struct runq *rq, struct proc *p)
+{
+  int level = rank(p);
+
+  if(level < 0){
+    // Don't let a process that slept for a long time
+    // monopolize the CPU to catch up; give it at most
+    // FAIRGRAN of credit over the queue's front.
+    if(rq->minvruntime > FAIRGRAN && p->vruntime < rq->minvruntime - FAIRGRAN)
+      p->vruntime = rq->minvruntime - FAIRGRAN;
+    p->rq_idx = rq->nfair++;
+    rq->fair[p->rq_idx] = p;
+    siftup(rq, p->rq_idx);
+  } else {
+    p->rq_next = 0;
+    p->rq_prev = rq->tail[level];
+    if(rq->tail[level])
+      rq->tail[level]->rq_next = p;
+    else
+      rq->head[level] = p;
+    rq->tail[level] = p;
+    if(level >= NPRIO)
+      rq->nrt++;
+  }
+  p->rq_level = level;
+  rq->nrunnable++;
+}
+
+// Unlink p from its priority list or the fair heap.
+// Caller must hold rq->lock.
+static void
+rqunlink(struct runq *rq, struct proc *p)
+{
+  int level = p->rq_level;
+  int i;
+
+  if(level < 0){
+    i = p->rq_idx;
+    rq->nfair--;
+    if(i != rq->nfair){
+      heapswap(rq, i, rq->nfair);
+      siftdown(rq, i);
+      siftup(rq, i);
+    }
+    rq->fair[rq->nfair] = 0;
+  } else {
+    if(p->rq_prev)
+      p->rq_prev->rq_next = p->rq_next;
+    else
+      rq->head[level] = p->rq_next;
+    if(p->rq_next)
+      p->rq_next->rq_prev = p->rq_prev;
+    else
+      rq->tail[level] = p->rq_prev;
+    p->rq_next = p->rq_prev = 0;
+    if(level >= NPRIO)
+      rq->nrt--;
+  }
+  p->rq_cpu = -1;
+  rq->nrunnable--;
+}
+
+// Pick a CPU from p's affinity mask for p to wait on:
+// an idle one if possible, else the least loaded one.
+static int
+allowedcpu(struct proc *p)
+{
+  int id, best = -1;
+  struct cpu *c;
+
+  for(id = 0; id < NCPU; id++){
+    if((p->affinity & cpusonline & (1UL << id)) == 0)
+      continue;
+    c = &cpus[id];
+    if(best < 0 || (!cpus[best].idle && c->idle) ||
+       (cpus[best].idle == c->idle && c->rq.nrunnable < cpus[best].rq.nrunnable))
+      best = id;
+  }
+  if(best < 0)
+    panic("allowedcpu");
+  return best;
+}
+
+// Put a RUNNABLE process on a run queue. Prefer the CPU it
+// last ran on, for cache locality, unless p would have to
+// wait there while another CPU is idle; a process that has
+// never run goes on the current CPU's queue. A process woken
+// by one on its own CPU with nothing else queued stays, since
+// the waker is likely about to block (a pipe or lock handoff)
+// and sched() can then switch straight to it.
+// Idle CPUs don't tick, so kick the chosen CPU with an IPI
+// if it is idle or p should preempt what it is running.
+// Caller must hold p->lock.
+void
+runqput(struct proc *p)
+{
+  struct runq *rq;
+  struct proc *q;
+  int id, alt, preempt;
+
+  if(!holding(&p->lock))
+    panic("runqput");
+  if(p->state != RUNNABLE || p->rq_cpu >= 0)
+    panic("runqput state");
+  priboost(p);
+
+  id = p->cpu >= 0 ? p->cpu : cpuid();
+  if((p->affinity & (1UL << id)) == 0){
+    id = allowedcpu(p);
+  } else if(!cpus[id].idle && (id != cpuid() || cpus[id].rq.nrunnable > 0)){
+    alt = allowedcpu(p);
+    if(cpus[alt].idle)
+      id = alt;
+  }
+  rq = &cpus[id].rq;
+
+  acquire(&rq->lock);
+  rqappend(rq, p);
+  p->rq_cpu = id;
+  release(&rq->lock);
+
+  // if p should run before what that CPU is running now,
+  // have it reschedule at the end of its next trap rather
+  // than wait for a tick. Unlocked, so only a hint; but
+  // release() was a fence, so an idle CPU either sees p on
+  // its queue or is seen here as idle (see scheduler()).
+  preempt = (q = cpus[id].proc) != 0 && q != p && rank(p) > rank(q);
+  if(preempt)
+    cpus[id].needresched = 1;
+  if(id != cpuid() && (preempt || cpus[id].idle))
+    ipisend(id);
+}
+
+// Return a process on one of rq's lower MLFQ lists that
+// hasn't caught up with MLFQ boost epoch (it may have
+// caught up with a later one meanwhile), or 0 if there is
+// none. Like runqget(), returns it without any lock held,
+// so it may have been dequeued since. See boostrunq().
+struct proc*
+runqstale(struct runq *rq, uint epoch)
+{
+  struct proc *p = 0;
+  int level;
+
+  if(rq->nrunnable == 0)
+    return 0;
+
+  acquire(&rq->lock);
+  // nothing on the top list can go any higher.
+  for(level = 0; level < NPRIO-1 && p == 0; level++)
+    for(p = rq->head[level]; p != 0 && (int)(epoch - p->boostepoch) <= 0; p = p->rq_next)
+      ;
+  release(&rq->lock);
+  return p;
+}
+
+// Take a process off whichever run queue it is on, if any.
+// Used when something that decides its queue position changes.
+// Caller must hold p->lock. Returns 1 if p was queued.
+int
+runqremove(struct proc *p)
+{
+  struct runq *rq;
+  int id;
+
+  if(!holding(&p->lock))
+    panic("runqremove");
+
+  // p->rq_cpu only changes under the run queue lock, so
+  // re-check it once that lock is held.
+  while((id = p->rq_cpu) >= 0){
+    rq = &cpus[id].rq;
+    acquire(&rq->lock);
+    if(p->rq_cpu == id){
+      rqunlink(rq, p);
+      release(&rq->lock);
+      return 1;
+    }
+    release(&rq->lock);
+  }
+  return 0;
+}
+
+// The fair process with the smallest virtual runtime on rq
+// among those allowed on the CPU with bit bit, or 0.
+// Caller must hold rq->lock.
+static struct proc*
+fairpick(struct runq *rq, uint64 bit)
+{
+  struct proc *p = 0;
+
+  if(rq->nfair == 0)
+    return 0;
+  if(rq->fair[0]->affinity & bit){
+    p = rq->fair[0];
+    if(p->vruntime > rq->minvruntime)
+      rq->minvruntime = p->vruntime;
+  } else {
+    // only when stealing: search the whole heap.
+    for(int i = 1; i < rq->nfair; i++){
+      if((rq->fair[i]->affinity & bit) &&
+         (p == 0 || rq->fair[i]->vruntime < p->vruntime))
+        p = rq->fair[i];
+    }
+  }
+  return p;
+}
+
+// Remove and return the process that should run next on
+// thief from c's queue: the highest-priority real-time or
+// MLFQ process, else the fair process with the smallest
+// virtual runtime,
+// among those allowed on thief. Returns 0 if there is none.
+static struct proc*
+rqtake(struct cpu *c, struct cpu *thief)
+{
+  struct runq *rq = &c->rq;
+  uint64 bit = 1UL << (thief - cpus);
+  struct proc *p = 0;
+  int top = NLEVEL - 1;
+  int level;
+
+  // Unlocked peek, so that idle CPUs polling each
+  // other's queues don't bounce the lock around.
+  if(rq->nrunnable == 0)
+    return 0;
+
+  acquire(&rq->lock);
+  // out of real-time budget: let anything else run first.
+  if(rq->nrt > 0 && rq->nrunnable > rq->nrt && throttled(rq))
+    top = NPRIO - 1;
+  for(level = top; level >= NPRIO && p == 0; level--){
+    for(p = rq->head[level]; p; p = p->rq_next)
+      if(p->affinity & bit)
+        break;
+  }
+  // out of MLFQ budget: let the fair processes have the rest
+  // of the period.
+  if(p == 0 && fairstarved(rq))
+    p = fairpick(rq, bit);
+  for(; level >= 0 && p == 0; level--){
+    for(p = rq->head[level]; p; p = p->rq_next)
+      if(p->affinity & bit)
+        break;
+  }
+  if(p == 0)
+    p = fairpick(rq, bit);
+  if(p)
+    rqunlink(rq, p);
+  release(&rq->lock);
+  return p;
+}
+
+// Remove and return the process that should run next on c.
+// Returns 0 if c's queue is empty.
+struct proc*
+runqget(struct cpu *c)
+{
+  return rqtake(c, c);
+}
+
+// Should the running process p give way to something
+// waiting on c's queue? A real-time or MLFQ process yields
+// to higher lists (a real-time one also when the CPU is out
+// of real-time budget and something else is waiting, an MLFQ
+// one when it is out of MLFQ budget and a fair one is); a
+// fair process yields to any list, or to a fair process
+// more than FAIRGRAN behind it, unless the fair processes
+// have the rest of the MLFQ period.
+// Unlocked, so only a hint.
+// Caller must hold p->lock.
+int
+runqpreempt(struct cpu *c, struct proc *p)
+{
+  struct runq *rq = &c->rq;
+  struct proc *q;
+  int level = rank(p), bottom = level;
+  int top = NLEVEL - 1;
+
+  if(throttled(rq)){
+    if(RTPOLICY(p->policy) && rq->nrunnable > rq->nrt)
+      return 1;
+    top = NPRIO - 1;
+  }
+  if(fairstarved(rq)){
+    if(p->policy == SCHED_MLFQ)
+      return 1;
+    // only real-time lists go before p.
+    if(p->policy == SCHED_FAIR && bottom < NPRIO - 1)
+      bottom = NPRIO - 1;
+  }
+  for(int i = top; i > bottom; i--)
+    if(rq->head[i])
+      return 1;
+  if(level < 0 && rq->nfair > 0){
+    q = rq->fair[0];
+    if(q && q->vruntime + FAIRGRAN < p->vruntime)
+      return 1;
+  }
+  return 0;
+}
+
+// p, a fair process, last ran on another CPU and is about
+// to run on c. Its virtual runtime is relative to its old
+// queue; carry its lag over to c's queue instead.
+// Caller must hold p->lock.
+void
+runqmigrate(struct proc *p, struct cpu *c)
+{
+  uint64 from = cpus[p->cpu].rq.minvruntime;
+
+  if(p->policy != SCHED_FAIR)
+    return;
+  if(p->vruntime > from)
+    p->vruntime = c->rq.minvruntime + (p->vruntime - from);
+  else
+    p->vruntime = c->rq.minvruntime;
+}
+
+// Find work for an idle CPU: take the next process from
+// the CPU with the longest run queue. A queue may hold only
+// processes pinned elsewhere, so try each CPU at most once.
+struct proc*
+runqsteal(struct cpu *thief)
+{
+  struct cpu *c, *victim;
+  struct proc *p;
+  uint64 tried = 1UL << (thief - cpus);
+
+  for(;;){
+    victim = 0;
+    for(c = cpus; c < &cpus[NCPU]; c++){
+      if((tried & (1UL << (c - cpus))) || c->rq.nrunnable == 0)
+        continue;
+      if(victim == 0 || c->rq.nrunnable > victim->rq.nrunnable)
+        victim = c;
+    }
+    if(victim == 0)
+      return 0;
+    // The lengths were read without locks; the victim may
+    // have drained its queue in the meantime, so look again.
+    if((p = rqtake(victim, thief)) != 0)
+      return p;
+    tried |= 1UL << (victim - cpus);
+  }
+}
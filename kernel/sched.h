@@ -0,0 +1,22 @@
+// Scheduling policies, for setsched() and getsched().
+#define SCHED_MLFQ   0  // multi-level feedback queue, by nice (default)
+#define SCHED_FAIR   1  // weighted fair share of the CPU, by nice
+#define SCHED_FIFO   2  // real-time, by priority; runs until it blocks
+#define SCHED_RR     3  // real-time, by priority; round-robin within one
+
+#define RTPOLICY(policy) ((policy) == SCHED_FIFO || (policy) == SCHED_RR)
+
+// Scheduler statistics, for schedstat(). Histogram bucket i
+// counts times from 2^i to 2^(i+1) microseconds; bucket 0
+// also counts anything shorter, and the last anything longer.
+#define NSCHEDHIST 20
+struct schedstat {
+  uint64 wait[NSCHEDHIST];  // Time spent RUNNABLE before getting a CPU
+  uint64 slice[NSCHEDHIST]; // Time run before giving up the CPU
+  uint64 waittime;          // Total of wait, in microseconds
+  uint64 runtime;           // Total of slice, in microseconds
+  uint64 nvcsw;             // Gave up the CPU to sleep or exit
+  uint64 nivcsw;            // Was preempted
+  uint64 npiboost;          // Ran at a sleep lock waiter's priority
+  uint64 ndirect;           // Switched to without going through scheduler()
+};
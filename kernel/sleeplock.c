@@ -1,4 +1,22 @@
 // Sleeping locks
+//
+// Sleep locks use priority inheritance. A process that has
+// to wait lends its run queue rank to the holder (see
+// piboost()), and the holder keeps the highest rank lent to
+// it until it releases the lock. Otherwise a low-priority
+// holder could be kept off the CPU by medium-priority work
+// while a high-priority process waits for it. The lock goes
+// to the highest-ranked waiter, oldest first among equals.
+//
+// A sleep lock made with initmutex() is adaptive: a process
+// that finds it held spins for a short while, as long as the
+// holder is running on another CPU, before going to sleep.
+// Locks held only briefly, such as buffer and inode locks,
+// are then usually taken without two context switches. A
+// spinner may take the lock before a waiter that release
+// woke, which is the price of not making it wait in line.
+//
+// Lock order: lk->lk, then p->lock.
 
 #include "types.h"
 #include "riscv.h"
@@ -9,6 +27,16 @@
 #include "proc.h"
 #include "sleeplock.h"
 
+// How long an adaptive lock's acquirer spins before
+// sleeping, in cycles: 10 microseconds.
+#define SPINCYCLES (TIMEBASE/100000)
+
+// A process waiting for a sleep lock, on its own stack.
+struct slwaiter {
+  struct proc *proc;
+  struct slwaiter *next;
+};
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
@@ -16,37 +44,165 @@ initsleeplock(struct sleeplock *lk, char *name)
   lk->name = name;
   lk->locked = 0;
   lk->pid = 0;
+  lk->waiters = 0;
+  lk->holder = 0;
+  lk->next = 0;
+  lk->adaptive = 0;
+#ifdef LOCKSTAT
+  lk->stat = lockstatfor(name, 1);
+#endif
+}
+
+// Make an adaptive sleep lock, for locks held only briefly.
+void
+initmutex(struct sleeplock *lk, char *name)
+{
+  initsleeplock(lk, name);
+  lk->adaptive = 1;
+}
+
+// lk is held; is it worth spinning for? Only if its holder
+// is running, and so may release it soon, and nothing is
+// waiting for this CPU. Reads without locks; it's a guess.
+static int
+spinworthy(struct sleeplock *lk)
+{
+  struct proc *h = __atomic_load_n(&lk->holder, __ATOMIC_RELAXED);
+
+  return h != 0 && __atomic_load_n(&h->state, __ATOMIC_RELAXED) == RUNNING &&
+         !needresched();
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  struct slwaiter w, **pp;
+
   acquire(&lk->lk);
+#ifdef LOCKSTAT
+  uint64 start = r_time();
+  int contended = lk->locked;
+#endif
+  if(lk->adaptive && lk->locked){
+    // spin, with lk->lk released so that the holder can
+    // release lk, while that may pay off.
+    uint64 deadline = r_time() + SPINCYCLES;
+    while(lk->locked && spinworthy(lk) && r_time() < deadline){
+      release(&lk->lk);
+      while(__atomic_load_n(&lk->locked, __ATOMIC_RELAXED) &&
+            spinworthy(lk) && r_time() < deadline)
+        ;
+      acquire(&lk->lk);
+    }
+  }
   while (lk->locked) {
-    sleep(lk, &lk->lk);
+    w.proc = p;
+    w.next = 0;
+    for(pp = &lk->waiters; *pp; pp = &(*pp)->next)
+      ;
+    *pp = &w;
+    piboost(lk->holder, runqrank(p));
+    sleep(&w, &lk->lk);
+    for(pp = &lk->waiters; *pp != &w; pp = &(*pp)->next)
+      ;
+    *pp = w.next;
   }
   lk->locked = 1;
-  lk->pid = myproc()->pid;
+  lk->pid = p->pid;
+  lk->holder = p;
+  lk->next = p->sleeplocks;
+  p->sleeplocks = lk;
+#ifdef LOCKSTAT
+  lk->acqtime = r_time();
+  lockstatacquired(lk->stat, contended, lk->acqtime - start);
+#endif
   release(&lk->lk);
 }
 
+// The highest rank among lk's waiters, or -1.
+// Caller must hold lk->lk.
+static int
+waitrank(struct sleeplock *lk)
+{
+  struct slwaiter *w;
+  int r = -1, wr;
+
+  for(w = lk->waiters; w; w = w->next)
+    if((wr = runqrank(w->proc)) > r)
+      r = wr;
+  return r;
+}
+
+// p has released a sleep lock and may have been running at
+// a waiter's rank. Drop back to the highest rank still lent
+// by waiters for locks p holds. Another process can lend p
+// a rank while this looks, so retry if that happened.
+static void
+piunboost(struct proc *p)
+{
+  struct sleeplock *l;
+  int gen, r, lr;
+
+  for(;;){
+    acquire(&p->lock);
+    gen = p->pigen;
+    release(&p->lock);
+
+    r = -1;
+    for(l = p->sleeplocks; l; l = l->next){
+      acquire(&l->lk);
+      if((lr = waitrank(l)) > r)
+        r = lr;
+      release(&l->lk);
+    }
+
+    acquire(&p->lock);
+    if(p->pigen == gen){
+      p->inherit = r;
+      release(&p->lock);
+      return;
+    }
+    release(&p->lock);
+  }
+}
+
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  struct sleeplock **pp;
+  struct slwaiter *w, *best = 0;
+
   acquire(&lk->lk);
+#ifdef LOCKSTAT
+  lockstatreleased(lk->stat, r_time() - lk->acqtime);
+#endif
   lk->locked = 0;
   lk->pid = 0;
-  wakeup(lk);
+  lk->holder = 0;
+  for(pp = &p->sleeplocks; *pp != lk; pp = &(*pp)->next)
+    ;
+  *pp = lk->next;
+  lk->next = 0;
+  for(w = lk->waiters; w; w = w->next)
+    if(best == 0 || runqrank(w->proc) > runqrank(best->proc))
+      best = w;
+  if(best)
+    wakeup(best);
   release(&lk->lk);
+
+  if(p->inherit >= 0)
+    piunboost(p);
 }
 
 int
 holdingsleep(struct sleeplock *lk)
 {
   int r;
-  
+
   acquire(&lk->lk);
-  r = lk->locked && (lk->pid == myproc()->pid);
+  r = lk->locked && (lk->holder == myproc());
   release(&lk->lk);
   return r;
 }
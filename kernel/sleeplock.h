@@ -2,9 +2,19 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+  struct slwaiter *waiters; // Processes waiting, oldest first
+  struct proc *holder;      // Process holding the lock
+  struct sleeplock *next;   // Next lock held by holder
+  int adaptive;             // Spin a while before sleeping; see initmutex()
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+
+#ifdef LOCKSTAT
+  // For lock statistics:
+  struct lockstat *stat; // Record for locks called name
+  uint64 acqtime;        // When the holder acquired it
+#endif
 };
 
@@ -1,4 +1,12 @@
 // Mutual exclusion spin locks.
+//
+// Ticket locks: acquire() takes a ticket with one atomic add
+// and then only reads lk->owner until its turn comes, and
+// release() hands the lock to the next ticket with a plain
+// store. Waiters are served first come, first served, so
+// none can starve, and while they wait they read a cache
+// line they share rather than fighting over it with atomic
+// swaps. lockbench() compares them with test-and-set locks.
 
 #include "types.h"
 #include "param.h"
@@ -7,13 +15,27 @@
 #include "riscv.h"
 #include "proc.h"
 #include "defs.h"
+#include "irqoff.h"
+
+#ifdef LATTRACE
+// The longest interrupts-off sections, by site. Each CPU
+// has its own table, hashed on pc, so recording one takes
+// no lock; irqoffstat() adds them up.
+static struct irqoff irqoffs[NCPU][NIRQOFF] __attribute__((aligned(CACHELINE)));
+
+static void irqoffend(struct cpu *c);
+#endif
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+#ifdef LOCKSTAT
+  lk->stat = lockstatfor(name, 0);
+#endif
 }
 
 // Acquire the lock.
@@ -21,15 +43,24 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
+#ifdef LATTRACE
+  if(mycpu()->noff == 1)
+    mycpu()->offpc = (uint64)__builtin_return_address(0);
+#endif
+  // On RISC-V, the fetch-and-add turns into an atomic add:
+  //   amoadd.w a5, a5, (s1)
+  ticket = __atomic_fetch_add(&lk->next, 1, __ATOMIC_RELAXED);
+#ifdef LOCKSTAT
+  uint64 start = r_time();
+  int contended = __atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != ticket;
+#endif
+  while(__atomic_load_n(&lk->owner, __ATOMIC_RELAXED) != ticket)
     ;
 
   // Tell the C compiler and the processor to not move loads or stores
@@ -40,6 +71,43 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+#ifdef LOCKSTAT
+  lk->acqtime = r_time();
+  lockstatacquired(lk->stat, contended, lk->acqtime - start);
+#endif
+}
+
+// Try to acquire the lock without spinning.
+// Returns 1 if it was acquired, 0 if it is held.
+int
+tryacquire(struct spinlock *lk)
+{
+  uint ticket;
+
+  push_off();
+  if(holding(lk))
+    panic("tryacquire");
+#ifdef LATTRACE
+  if(mycpu()->noff == 1)
+    mycpu()->offpc = (uint64)__builtin_return_address(0);
+#endif
+
+  // take a ticket only if it would be served at once: if
+  // next == owner when the compare-and-swap succeeds, owner
+  // can't have moved, since it never passes next.
+  ticket = __atomic_load_n(&lk->owner, __ATOMIC_RELAXED);
+  if(!__atomic_compare_exchange_n(&lk->next, &ticket, ticket + 1, 0,
+                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    pop_off();
+    return 0;
+  }
+  __sync_synchronize();
+  lk->cpu = mycpu();
+#ifdef LOCKSTAT
+  lk->acqtime = r_time();
+  lockstatacquired(lk->stat, 0, 0);
+#endif
+  return 1;
 }
 
 // Release the lock.
@@ -49,6 +117,9 @@ release(struct spinlock *lk)
   if(!holding(lk))
     panic("release");
 
+#ifdef LOCKSTAT
+  lockstatreleased(lk->stat, r_time() - lk->acqtime);
+#endif
   lk->cpu = 0;
 
   // Tell the C compiler and the CPU to not move loads or stores
@@ -59,14 +130,10 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // Serve the next ticket. Only the holder writes owner, but
+  // use an atomic store rather than a C assignment, which
+  // might be implemented with multiple store instructions.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELAXED);
 
   pop_off();
 }
@@ -77,10 +144,108 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->next != lk->owner && lk->cpu == mycpu());
   return r;
 }
 
+void
+initrwlock(struct rwspinlock *rw, char *name)
+{
+  initlock(&rw->w, name);
+  rw->readers = 0;
+}
+
+// Acquire rw for reading. Waits while a writer holds it or
+// is waiting for it.
+void
+acquireread(struct rwspinlock *rw)
+{
+  push_off(); // like acquire().
+  for(;;){
+    while(__atomic_load_n(&rw->w.next, __ATOMIC_RELAXED) !=
+          __atomic_load_n(&rw->w.owner, __ATOMIC_RELAXED))
+      ;
+    __atomic_fetch_add(&rw->readers, 1, __ATOMIC_SEQ_CST);
+    // a writer may have come along in between; if so, it
+    // goes first.
+    if(__atomic_load_n(&rw->w.next, __ATOMIC_SEQ_CST) ==
+       __atomic_load_n(&rw->w.owner, __ATOMIC_SEQ_CST))
+      break;
+    __atomic_fetch_sub(&rw->readers, 1, __ATOMIC_RELAXED);
+  }
+  __sync_synchronize();
+}
+
+void
+releaseread(struct rwspinlock *rw)
+{
+  __atomic_fetch_sub(&rw->readers, 1, __ATOMIC_RELEASE);
+  pop_off();
+}
+
+// Acquire rw for writing: take the writers' lock, which
+// keeps new readers out, and wait for the readers to leave.
+void
+acquirewrite(struct rwspinlock *rw)
+{
+  acquire(&rw->w);
+  while(__atomic_load_n(&rw->readers, __ATOMIC_SEQ_CST) != 0)
+    ;
+  __sync_synchronize();
+}
+
+void
+releasewrite(struct rwspinlock *rw)
+{
+  release(&rw->w);
+}
+
+void
+initseqlock(struct seqlock *sl, char *name)
+{
+  initlock(&sl->lk, name);
+  sl->seq = 0;
+}
+
+// Start reading data protected by sl. Pass the result to
+// seqreadretry() when done.
+uint
+seqreadbegin(struct seqlock *sl)
+{
+  uint seq;
+
+  while((seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1)
+    ;
+  __sync_synchronize();
+  return seq;
+}
+
+// Did a writer change the data since seqreadbegin()
+// returned seq? If so, what was read may be inconsistent;
+// read it again.
+int
+seqreadretry(struct seqlock *sl, uint seq)
+{
+  __sync_synchronize();
+  return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != seq;
+}
+
+void
+seqwritebegin(struct seqlock *sl)
+{
+  acquire(&sl->lk);
+  __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+  __sync_synchronize();
+}
+
+void
+seqwriteend(struct seqlock *sl)
+{
+  __sync_synchronize();
+  __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+  release(&sl->lk);
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
@@ -94,8 +259,13 @@ push_off(void)
   // switch while using mycpu().
   intr_off();
 
-  if(mycpu()->noff == 0)
+  if(mycpu()->noff == 0){
     mycpu()->intena = old;
+#ifdef LATTRACE
+    mycpu()->offstart = r_time();
+    mycpu()->offpc = (uint64)__builtin_return_address(0);
+#endif
+  }
   mycpu()->noff += 1;
 }
 
@@ -108,6 +278,120 @@ pop_off(void)
   if(c->noff < 1)
     panic("pop_off");
   c->noff -= 1;
-  if(c->noff == 0 && c->intena)
+  if(c->noff == 0 && c->intena){
+#ifdef LATTRACE
+    irqoffend(c);
+#endif
     intr_on();
+  }
+}
+
+#ifdef LATTRACE
+// c is about to turn interrupts back on: charge the
+// section since c->offstart to c->offpc.
+static void
+irqoffend(struct cpu *c)
+{
+  struct irqoff *t = irqoffs[c - cpus];
+  uint64 us = (r_time() - c->offstart) / (TIMEBASE/1000000);
+  uint i, h = (c->offpc >> 2) % NIRQOFF;
+
+  for(i = 0; i < NIRQOFF; i++, h = (h + 1) % NIRQOFF){
+    if(t[h].pc == c->offpc || t[h].pc == 0)
+      break;
+  }
+  if(i == NIRQOFF)
+    return;  // table full; drop it
+  t[h].pc = c->offpc;
+  t[h].count++;
+  t[h].total += us;
+  if(us > t[h].max)
+    t[h].max = us;
+}
+#endif
+
+// Copy up to n interrupts-off sites, added up over all
+// CPUs, to user address addr, and clear the tables if
+// reset is set. Other CPUs keep recording meanwhile, so
+// the numbers are only approximate. Returns the number of
+// sites, or -1 if the kernel wasn't built with LATTRACE.
+int
+irqoffstat(uint64 addr, int n, int reset)
+{
+#ifdef LATTRACE
+  struct irqoff *sum, *t;
+  int cpu, i, j, nsum = 0;
+
+  // too big for the stack.
+  if((sum = kalloc()) == 0)
+    return -1;
+  for(cpu = 0; cpu < NCPU; cpu++){
+    for(i = 0; i < NIRQOFF; i++){
+      t = &irqoffs[cpu][i];
+      if(t->pc == 0)
+        continue;
+      for(j = 0; j < nsum && sum[j].pc != t->pc; j++)
+        ;
+      if(j == nsum){
+        if(nsum == NIRQOFF)
+          continue;
+        sum[nsum].pc = t->pc;
+        sum[nsum].count = sum[nsum].max = sum[nsum].total = 0;
+        nsum++;
+      }
+      sum[j].count += t->count;
+      sum[j].total += t->total;
+      if(t->max > sum[j].max)
+        sum[j].max = t->max;
+    }
+    if(reset)
+      memset(irqoffs[cpu], 0, sizeof(irqoffs[cpu]));
+  }
+  if(n > nsum)
+    n = nsum;
+  if(n > 0 && copyout(myproc()->pagetable, addr, (char *)sum, n * sizeof(sum[0])) < 0)
+    n = -1;
+  kfree(sum);
+  return n;
+#else
+  return -1;
+#endif
+}
+
+// For lockbench(): a ticket lock (zeroed is unlocked), a
+// test-and-set lock as acquire() used to be, and the data
+// they protect.
+static struct {
+  struct spinlock ticket;
+  uint tas;
+  uint64 count;
+} bench __attribute__((aligned(CACHELINE)));
+
+// Take and release the benchmark's ticket lock n times, or
+// if tas is set its test-and-set lock. Several CPUs running
+// this at once contend for the lock. Returns the time it
+// took in microseconds; how far that differs between CPUs
+// shows how fairly the lock is handed out.
+int
+lockbench(int tas, int n)
+{
+  uint64 start = r_time();
+
+  for(int i = 0; i < n; i++){
+    if(tas){
+      push_off();
+      while(__sync_lock_test_and_set(&bench.tas, 1) != 0)
+        ;
+      __sync_synchronize();
+      bench.count++;
+      __sync_synchronize();
+      __sync_lock_release(&bench.tas);
+      pop_off();
+    } else {
+      acquire(&bench.ticket);
+      bench.count++;
+      release(&bench.ticket);
+    }
+  }
+  return (r_time() - start) / (TIMEBASE/1000000);
 }
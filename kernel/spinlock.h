@@ -1,9 +1,33 @@
-// Mutual exclusion lock.
+// Mutual exclusion lock: a ticket lock. Each acquirer takes
+// the next ticket and waits until owner reaches it, so CPUs
+// get the lock in the order they asked for it.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket now allowed to hold the lock
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+
+#ifdef LOCKSTAT
+  // For lock statistics:
+  struct lockstat *stat; // Record for locks called name
+  uint64 acqtime;        // When the holder acquired it
+#endif
+};
+
+// Reader-writer spinlock: any number of readers, or one
+// writer. A writer waiting for the readers to leave keeps
+// new ones out, so a reader must not take it twice.
+struct rwspinlock {
+  struct spinlock w; // Held by the writer; writers take turns
+  uint readers;      // Number of readers holding it
 };
 
+// Sequence lock, for data read far more often than written.
+// Readers take no lock: they read, and read again if a
+// writer was at work meanwhile.
+struct seqlock {
+  struct spinlock lk; // Held by the writer
+  uint seq;           // Odd while the writer is at work
+};
@@ -6,10 +6,16 @@
 
 void main();
 void timerinit();
+void ipiinit();
+extern void machinevec();
 
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
+// a scratch area per CPU for machinevec in kernelvec.S,
+// each in a cache line of its own.
+__attribute__ ((aligned (CACHELINE))) uint64 mscratch0[NCPU][CACHELINE/8];
+
 // entry.S jumps here in machine mode on stack0.
 void
 start()
@@ -30,7 +36,7 @@ start()
   // delegate all interrupts and exceptions to supervisor mode.
   w_medeleg(0xffff);
   w_mideleg(0xffff);
-  w_sie(r_sie() | SIE_SEIE | SIE_STIE);
+  w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
   // configure Physical Memory Protection to give supervisor mode
   // access to all of physical memory.
@@ -40,6 +46,9 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // take inter-processor interrupts.
+  ipiinit();
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -62,5 +71,17 @@ timerinit()
   w_mcounteren(r_mcounteren() | 2);
   
   // ask for the very first timer interrupt.
-  w_stimecmp(r_time() + 1000000);
+  w_stimecmp(r_time() + TICKCYCLES);
+}
+
+// other harts interrupt this one by writing its MSIP register
+// in the CLINT. that raises a machine software interrupt, which
+// can't be delegated, so catch it in machine mode and pass it on
+// to supervisor mode as a software interrupt (see machinevec).
+void
+ipiinit()
+{
+  w_mscratch((uint64)mscratch0[r_mhartid()]);
+  w_mtvec((uint64)machinevec);
+  w_mie(r_mie() | MIE_MSIE);
 }
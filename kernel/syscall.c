@@ -4,6 +4,7 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "pcount.h"
 #include "syscall.h"
 #include "defs.h"
 #include "strace.h"
@@ -13,7 +14,7 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz) // both tests needed, in case of overflow
+  if(addr >= p->leader->sz || addr+sizeof(uint64) > p->leader->sz) // both tests needed, in case of overflow
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -111,6 +112,22 @@ extern uint64 sys_nice(void);
 extern uint64 sys_getcwd(void);
 extern uint64 sys_freemem(void);
 extern uint64 sys_mmap(void);
+extern uint64 sys_setsched(void);
+extern uint64 sys_getsched(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_setaffinity(void);
+extern uint64 sys_getaffinity(void);
+extern uint64 sys_schedstat(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_join(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_irqoffstat(void);
+extern uint64 sys_reclaimstat(void);
+extern uint64 sys_pcount(void);
+extern uint64 sys_irqroute(void);
+extern uint64 sys_lockbench(void);
+extern uint64 sys_lockstat(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -145,6 +162,22 @@ static uint64 (*syscalls[])(void) = {
 [SYS_getcwd] sys_getcwd,
 [SYS_freemem] sys_freemem,
 [SYS_mmap] sys_mmap,
+[SYS_setsched] sys_setsched,
+[SYS_getsched] sys_getsched,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_getaffinity] sys_getaffinity,
+[SYS_schedstat] sys_schedstat,
+[SYS_clone] sys_clone,
+[SYS_join] sys_join,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_irqoffstat] sys_irqoffstat,
+[SYS_reclaimstat] sys_reclaimstat,
+[SYS_pcount] sys_pcount,
+[SYS_irqroute] sys_irqroute,
+[SYS_lockbench] sys_lockbench,
+[SYS_lockstat] sys_lockstat,
 };
 
 void
@@ -158,6 +191,7 @@ syscall(void)
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
 	p->counter++; // increase sys call counter 
+    pcountinc(PC_SYSCALL);
     
     uint64 ptr = syscalls[num]();
    
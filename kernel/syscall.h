@@ -29,3 +29,19 @@
 #define SYS_getcwd 28
 #define SYS_freemem 29
 #define SYS_mmap 30
+#define SYS_setsched 31
+#define SYS_getsched 32
+#define SYS_nanosleep 33
+#define SYS_setaffinity 34
+#define SYS_getaffinity 35
+#define SYS_schedstat 36
+#define SYS_clone 37
+#define SYS_join 38
+#define SYS_futex_wait 39
+#define SYS_futex_wake 40
+#define SYS_irqoffstat 41
+#define SYS_reclaimstat 42
+#define SYS_pcount 43
+#define SYS_irqroute 44
+#define SYS_lockbench 45
+#define SYS_lockstat 46
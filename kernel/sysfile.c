@@ -18,15 +18,25 @@
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
+// Another thread may close the descriptor meanwhile, so this takes
+// a reference to the file, which the caller must fileclose().
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
   int fd;
   struct file *f;
+  struct proc *g = myproc()->leader;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE)
     return -1;
+  acquire(&g->glock);
+  if((f=g->ofile[fd]) == 0){
+    release(&g->glock);
+    return -1;
+  }
+  filedup(f);
+  release(&g->glock);
   if(pfd)
     *pfd = fd;
   if(pf)
@@ -40,17 +50,40 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct proc *g = myproc()->leader;
 
+  // the group lock keeps other threads from taking
+  // the same descriptor.
+  acquire(&g->glock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(g->ofile[fd] == 0){
+      g->ofile[fd] = f;
+      release(&g->glock);
       return fd;
     }
   }
+  release(&g->glock);
   return -1;
 }
 
+// Undo fdalloc(fd) of f, unless another thread has closed
+// fd meanwhile, in which case that thread dropped the reference
+// and fd may now hold something else.
+static void
+fdfree(int fd, struct file *f)
+{
+  struct proc *g = myproc()->leader;
+
+  acquire(&g->glock);
+  if(g->ofile[fd] != f){
+    release(&g->glock);
+    return;
+  }
+  g->ofile[fd] = 0;
+  release(&g->glock);
+  fileclose(f);
+}
+
 uint64
 sys_dup(void)
 {
@@ -59,9 +92,11 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  // the new descriptor takes over argfd()'s reference.
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -69,29 +104,32 @@ uint64
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
 
   argaddr(1, &p);
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   uint64 p;
   
   argaddr(1, &p);
   argint(2, &n);
   if(argfd(0, 0, &f) < 0)
     return -1;
-
-  return filewrite(f, p, n);
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 uint64
@@ -99,10 +137,20 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct proc *g = myproc()->leader;
 
-  if(argfd(0, &fd, &f) < 0)
+  // another thread may be closing fd too; only one
+  // of them gets to drop the reference.
+  argint(0, &fd);
+  if(fd < 0 || fd >= NOFILE)
+    return -1;
+  acquire(&g->glock);
+  if((f = g->ofile[fd]) == 0){
+    release(&g->glock);
     return -1;
-  myproc()->ofile[fd] = 0;
+  }
+  g->ofile[fd] = 0;
+  release(&g->glock);
   fileclose(f);
   return 0;
 }
@@ -112,11 +160,14 @@ sys_fstat(void)
 {
   struct file *f;
   uint64 st; // user pointer to struct stat
+  int r;
 
   argaddr(1, &st);
   if(argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -438,8 +489,8 @@ uint64
 sys_chdir(void)
 {
   char path[MAXPATH];
-  struct inode *ip;
-  struct proc *p = myproc();
+  struct inode *ip, *old;
+  struct proc *g = myproc()->leader;
   
   begin_op();
   if(argstr(0, path, MAXPATH) < 0 || (ip = namei(path)) == 0){
@@ -453,9 +504,12 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(p->cwd);
+  acquire(&g->glock);
+  old = g->cwd;
+  g->cwd = ip;
+  release(&g->glock);
+  iput(old);
   end_op();
-  p->cwd = ip;
   return 0;
 }
 
@@ -516,17 +570,16 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
+      fdfree(fd0, rf);
+    else
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
+    fdfree(fd0, rf);
+    fdfree(fd1, wf);
     return -1;
   }
   return 0;
@@ -54,20 +54,11 @@ sys_sbrk(void)
 
   argint(0, &n);
   argint(1, &t);
-  addr = myproc()->sz;
-
-  if(t == SBRK_EAGER || n < 0) {
-    if(growproc(n) < 0) {
-      return -1;
-    }
-  } else {
-    // Lazily allocate memory for this process: increase its memory
-    // size but don't allocate memory. If the processes uses the
-    // memory, vmfault() will allocate it.
-    if(addr + n < addr)
-      return -1;
-    myproc()->sz += n;
-  }
+
+  // Unless asked to be eager, lazily allocate memory for this
+  // process: increase its memory size but don't allocate memory.
+  // If the processes uses the memory, vmfault() will allocate it.
+  addr = growproc(n, t != SBRK_EAGER);
   return addr;
 }
 
@@ -75,22 +66,29 @@ uint64
 sys_pause(void)
 {
   int n;
-  uint ticks0;
 
   argint(0, &n);
   if(n < 0)
     n = 0;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return timersleep(r_time() + (uint64)n * TICKCYCLES);
+}
+
+// The time CSR value ns nanoseconds from now, rounded
+// up to whole cycles.
+static uint64
+nsdeadline(uint64 ns)
+{
+  return r_time() + (ns * (TIMEBASE/1000000) + 999) / 1000;
+}
+
+// sleep for at least ns nanoseconds.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  argaddr(0, &ns);
+  return timersleep(nsdeadline(ns));
 }
 
 uint64
@@ -102,17 +100,11 @@ sys_kill(void)
   return kkill(pid);
 }
 
-// return how many clock tick interrupts have occurred
-// since start.
+// return how many clock ticks have gone by since start.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return uptimeticks();
 }
 
 // shutdown
@@ -168,6 +160,7 @@ sys_nice(void)
 	
 	p->nice = n;
 	p->priority = 3 - n;
+	p->slice = 0;
 	release(&p->lock);
 	
 	return p->priority;
@@ -183,7 +176,7 @@ sys_freemem(void)
 uint64
 sys_mmap(void)
 {
-  struct proc *p = myproc();
+  struct proc *g = myproc()->leader;
 
   void *pa = kalloc();
   if(pa == 0)
@@ -191,19 +184,205 @@ sys_mmap(void)
 
   memset(pa, 0, PGSIZE);
 
-  uint64 va = p->mmap - PGSIZE;
+  acquire(&g->glock);
+  uint64 va = g->mmap - PGSIZE;
 
-  if(mappages(p->pagetable, va, PGSIZE, (uint64)pa,
+  if(mappages(g->pagetable, va, PGSIZE, (uint64)pa,
               PTE_R | PTE_W | PTE_U) < 0){
+    release(&g->glock);
     kfree(pa);
     return (uint64)-1;
   }
 
-  if(walkaddr(p->pagetable, va) != (uint64)pa)
+  if(walkaddr(g->pagetable, va) != (uint64)pa)
     panic("sys_mmap: mapping error");
 
-  p->mmap = va;
-  p->mmap_pages++;
+  g->mmap = va;
+  g->mmap_pages++;
+  release(&g->glock);
 
   return va;
 }
+
+uint64
+sys_setsched(void)
+{
+  int pid, policy, rtprio;
+
+  argint(0, &pid);
+  argint(1, &policy);
+  argint(2, &rtprio);
+  return setsched(pid, policy, rtprio);
+}
+
+uint64
+sys_getsched(void)
+{
+  int pid, policy, rtprio;
+  uint64 urtprio;
+
+  argint(0, &pid);
+  argaddr(1, &urtprio);
+  if((policy = getsched(pid, &rtprio)) < 0)
+    return -1;
+  if(urtprio != 0 && copyout(myproc()->pagetable, urtprio, (char *)&rtprio,
+                             sizeof(rtprio)) < 0)
+    return -1;
+  return policy;
+}
+
+uint64
+sys_setaffinity(void)
+{
+  int pid;
+  uint64 mask;
+
+  argint(0, &pid);
+  argaddr(1, &mask);
+  if(setaffinity(pid, mask) < 0)
+    return -1;
+  // move off this CPU now if it was taken away.
+  if(pid == 0 || pid == myproc()->pid)
+    yield();
+  return 0;
+}
+
+uint64
+sys_getaffinity(void)
+{
+  int pid, nmigrations;
+  uint64 mask, umask, unmig;
+  struct proc *p = myproc();
+
+  argint(0, &pid);
+  argaddr(1, &umask);
+  argaddr(2, &unmig);
+  if(getaffinity(pid, &mask, &nmigrations) < 0)
+    return -1;
+  if(umask != 0 && copyout(p->pagetable, umask, (char *)&mask, sizeof(mask)) < 0)
+    return -1;
+  if(unmig != 0 && copyout(p->pagetable, unmig, (char *)&nmigrations,
+                           sizeof(nmigrations)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_schedstat(void)
+{
+  int pid, cpu;
+  uint64 st;
+
+  argint(0, &pid);
+  argint(1, &cpu);
+  argaddr(2, &st);
+  return schedstat(pid, cpu, st);
+}
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  return kclone(fn, arg, stack);
+}
+
+uint64
+sys_join(void)
+{
+  int tid;
+
+  argint(0, &tid);
+  return kjoin(tid);
+}
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr, ns;
+  int val;
+
+  argaddr(0, &addr);
+  argint(1, &val);
+  argaddr(2, &ns);
+  // a timeout of 0 means wait forever.
+  return futexwait(addr, val, ns ? nsdeadline(ns) : 0);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  argaddr(0, &addr);
+  argint(1, &n);
+  return futexwake(addr, n);
+}
+
+uint64
+sys_irqoffstat(void)
+{
+  uint64 sites;
+  int n, reset;
+
+  argaddr(0, &sites);
+  argint(1, &n);
+  argint(2, &reset);
+  return irqoffstat(sites, n, reset);
+}
+
+uint64
+sys_reclaimstat(void)
+{
+  uint64 st;
+
+  argaddr(0, &st);
+  return reclaimstat(st);
+}
+
+uint64
+sys_pcount(void)
+{
+  int cpu;
+  uint64 counts;
+
+  argint(0, &cpu);
+  argaddr(1, &counts);
+  return pcount(cpu, counts);
+}
+
+uint64
+sys_irqroute(void)
+{
+  int irq, cpu;
+
+  argint(0, &irq);
+  argint(1, &cpu);
+  return irqroute(irq, cpu);
+}
+
+uint64
+sys_lockbench(void)
+{
+  int tas, n;
+
+  argint(0, &tas);
+  argint(1, &n);
+  return lockbench(tas, n);
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 stats;
+  int n, reset;
+
+  argaddr(0, &stats);
+  argint(1, &n);
+  argint(2, &reset);
+  return lockstat(stats, n, reset);
+}
@@ -0,0 +1,239 @@
+// Per-CPU timer queues.
+//
+// Each CPU keeps the timers that were added on it in a
+// min-heap ordered by expiry time, and programs stimecmp
+// for whichever comes first: its earliest timer, or the
+// next scheduler tick. clockintr() runs the expired ones.
+//
+// A timer's callback runs in the clock interrupt with the
+// queue lock held, so it must be short and must not add
+// or delete timers; waking a process is the usual job.
+// Because of that lock, once timerdel() returns the
+// callback is not running and will not run.
+//
+// Lock order: the queue lock, then wait queue and proc locks.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+#define NTIMER (2*NPROC)  // timers per CPU
+
+struct timerq {
+  struct spinlock lock;
+  struct timer *heap[NTIMER];
+  int n;
+} __attribute__((aligned(CACHELINE)));
+
+static struct timerq timerq[NCPU];
+
+void
+timerqinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&timerq[i].lock, "timerq");
+}
+
+void
+inittimer(struct timer *t, void (*fn)(struct timer*), void *arg)
+{
+  t->expires = 0;
+  t->fn = fn;
+  t->arg = arg;
+  t->cpu = -1;
+  t->idx = -1;
+}
+
+static void
+heapswap(struct timerq *q, int i, int j)
+{
+  struct timer *t = q->heap[i];
+
+  q->heap[i] = q->heap[j];
+  q->heap[j] = t;
+  q->heap[i]->idx = i;
+  q->heap[j]->idx = j;
+}
+
+static void
+siftup(struct timerq *q, int i)
+{
+  while(i > 0 && q->heap[i]->expires < q->heap[(i-1)/2]->expires){
+    heapswap(q, i, (i-1)/2);
+    i = (i-1)/2;
+  }
+}
+
+static void
+siftdown(struct timerq *q, int i)
+{
+  int l, m;
+
+  for(;;){
+    m = i;
+    l = 2*i + 1;
+    if(l < q->n && q->heap[l]->expires < q->heap[m]->expires)
+      m = l;
+    if(l+1 < q->n && q->heap[l+1]->expires < q->heap[m]->expires)
+      m = l+1;
+    if(m == i)
+      break;
+    heapswap(q, i, m);
+    i = m;
+  }
+}
+
+// Take t off queue q.
+// Caller must hold q->lock.
+static void
+heapdel(struct timerq *q, struct timer *t)
+{
+  int i = t->idx;
+
+  q->n--;
+  if(i != q->n){
+    heapswap(q, i, q->n);
+    siftdown(q, i);
+    siftup(q, i);
+  }
+  q->heap[q->n] = 0;
+  t->cpu = -1;
+  t->idx = -1;
+}
+
+// Program this CPU's timer for its next deadline: its
+// earliest timer or its next tick, whichever is sooner.
+// Writing stimecmp also clears a pending timer interrupt.
+void
+timerarm(void)
+{
+  struct timerq *q;
+  uint64 next;
+
+  push_off();
+  q = &timerq[cpuid()];
+  next = mycpu()->nexttick;
+  acquire(&q->lock);
+  if(q->n > 0 && q->heap[0]->expires < next)
+    next = q->heap[0]->expires;
+  release(&q->lock);
+  w_stimecmp(next);
+  pop_off();
+}
+
+// Queue t to fire when the time CSR reaches expires,
+// on the current CPU.
+void
+timeradd(struct timer *t, uint64 expires)
+{
+  struct timerq *q;
+  int first;
+
+  push_off();
+  q = &timerq[cpuid()];
+  acquire(&q->lock);
+  if(t->cpu >= 0)
+    panic("timeradd");
+  if(q->n == NTIMER)
+    panic("timeradd: full");
+  t->expires = expires;
+  t->cpu = cpuid();
+  t->idx = q->n++;
+  q->heap[t->idx] = t;
+  siftup(q, t->idx);
+  first = t->idx == 0;
+  release(&q->lock);
+  if(first)
+    timerarm();
+  pop_off();
+}
+
+// Cancel t. Returns 1 if it was still queued, 0 if it
+// had already fired (or was never added).
+int
+timerdel(struct timer *t)
+{
+  struct timerq *q;
+  int id;
+
+  // t->cpu only changes under the queue lock, so
+  // re-check it once that lock is held.
+  while((id = t->cpu) >= 0){
+    q = &timerq[id];
+    acquire(&q->lock);
+    if(t->cpu == id){
+      heapdel(q, t);
+      release(&q->lock);
+      return 1;
+    }
+    release(&q->lock);
+  }
+  return 0;
+}
+
+// Run this CPU's expired timers and reprogram its timer.
+// Called from clockintr().
+void
+timerexpire(void)
+{
+  struct timerq *q = &timerq[cpuid()];
+  struct timer *t;
+  uint64 now = r_time();
+
+  acquire(&q->lock);
+  while(q->n > 0 && (t = q->heap[0])->expires <= now){
+    heapdel(q, t);
+    // leave t->cpu set while fn runs, so that timerdel()
+    // waits for it on the queue lock.
+    t->cpu = q - timerq;
+    t->fn(t);
+    t->cpu = -1;
+  }
+  release(&q->lock);
+  timerarm();
+}
+
+static void
+timerwake(struct timer *t)
+{
+  wakeup(t);
+}
+
+// Sleep until the time CSR reaches deadline.
+// Returns 0, or -1 if the process was killed.
+int
+timersleep(uint64 deadline)
+{
+  struct timer t;
+  struct timerq *q;
+  int r = 0;
+
+  if(deadline <= r_time())
+    return 0;
+
+  // t stays on the queue it was added to, even if this
+  // process moves to another CPU, so that queue's lock is
+  // the condition lock for the wakeup.
+  inittimer(&t, timerwake, myproc());
+  push_off();
+  q = &timerq[cpuid()];
+  timeradd(&t, deadline);
+  pop_off();
+
+  acquire(&q->lock);
+  while(t.cpu >= 0){
+    if(killed(myproc())){
+      heapdel(q, &t);
+      r = -1;
+      break;
+    }
+    sleep(&t, &q->lock);
+  }
+  release(&q->lock);
+  return r;
+}
@@ -0,0 +1,10 @@
+// Kernel timers, kept in per-CPU queues (see timer.c).
+struct timer {
+  uint64 expires;            // Value of the time CSR to fire at
+  void (*fn)(struct timer*); // Called with the queue lock held
+  void *arg;                 // For fn
+
+  // the queue lock must be held when using these:
+  int cpu;                   // CPU whose queue t is on, or -1
+  int idx;                   // Index in that queue's heap
+};
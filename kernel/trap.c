@@ -4,10 +4,10 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "pcount.h"
 #include "defs.h"
 
-struct spinlock tickslock;
-uint ticks;
+uint64 boottime; // time CSR when the kernel started
 
 extern char trampoline[], uservec[];
 
@@ -19,7 +19,16 @@ extern int devintr();
 void
 trapinit(void)
 {
-  initlock(&tickslock, "time");
+  boottime = r_time();
+}
+
+// Clock ticks since boot. Counted from the time CSR rather
+// than by any CPU's tick, so that every CPU, CPU 0 included,
+// may stop ticking while idle.
+uint
+uptimeticks(void)
+{
+  return (r_time() - boottime) / TICKCYCLES;
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -45,6 +54,7 @@ usertrap(void)
   // send interrupts and exceptions to kerneltrap(),
   // since we're now in the kernel.
   w_stvec((uint64)kernelvec);
+  mycpu()->userseq++;
 
   struct proc *p = myproc();
   
@@ -80,8 +90,10 @@ usertrap(void)
   if(killed(p))
     kexit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt
+  // and the process's time slice has run out, or if
+  // something that should run first has been queued.
+  if((which_dev == 2 && schedtick()) || needresched())
     yield();
 
   prepare_return();
@@ -105,6 +117,7 @@ prepare_return(void)
   // kerneltrap() to usertrap(). because a trap from kernel
   // code to usertrap would be a disaster, turn off interrupts.
   intr_off();
+  mycpu()->userseq++;
 
   // send syscalls, interrupts, and exceptions to uservec in trampoline.S
   uint64 trampoline_uservec = TRAMPOLINE + (uservec - trampoline);
@@ -117,6 +130,9 @@ prepare_return(void)
   p->trapframe->kernel_trap = (uint64)usertrap;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
 
+  // tell trampoline.S where this thread's trapframe is.
+  w_sscratch(THREADFRAME(p->tslot));
+
   // set up the registers that trampoline.S's sret will use
   // to get to user space.
   
@@ -151,8 +167,10 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0)
+  // give up the CPU if this is a timer interrupt
+  // and the process's time slice has run out, or if
+  // something that should run first has been queued.
+  if(myproc() != 0 && ((which_dev == 2 && schedtick()) || needresched()))
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -161,20 +179,32 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
-void
+int
 clockintr()
 {
-  if(cpuid() == 0){
-    acquire(&tickslock);
-    ticks++;
-    wakeup(&ticks);
-    release(&tickslock);
+  struct cpu *c = mycpu();
+  uint64 now = r_time();
+  int tick = 0;
+
+  // the interrupt may be for a timer rather than the tick.
+  if(now >= c->nexttick){
+    tick = 1;
+
+    // an idle CPU has no slice to time, and whoever gives
+    // it work sends an IPI, so it stops ticking. time is
+    // kept by the time CSR, so this holds for CPU 0 too;
+    // the timer is then armed only for real deadlines.
+    if(c->idle)
+      c->nexttick = -1;
+    else
+      c->nexttick = now + TICKCYCLES;
   }
 
-  // ask for the next timer interrupt. this also clears
-  // the interrupt request. 1000000 is about a tenth
-  // of a second.
-  w_stimecmp(r_time() + 1000000);
+  // run expired timers, and ask for the next timer
+  // interrupt. this also clears the interrupt request.
+  timerexpire();
+
+  return tick;
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -193,6 +223,8 @@ devintr()
     // irq indicates which device interrupted.
     int irq = plic_claim();
 
+    pcountinc(PC_DEVINTR);
+
     if(irq == UART0_IRQ){
       uartintr();
     } else if(irq == VIRTIO0_IRQ){
@@ -209,9 +241,16 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000005L){
-    // timer interrupt.
-    clockintr();
-    return 2;
+    // timer interrupt. only a scheduler tick counts
+    // as one for yielding.
+    pcountinc(PC_TIMER);
+    return clockintr() ? 2 : 1;
+  } else if(scause == 0x8000000000000001L){
+    // software interrupt: an IPI from another CPU,
+    // forwarded by machinevec in kernelvec.S.
+    pcountinc(PC_IPI);
+    ipiintr();
+    return 1;
   } else {
     return 0;
   }
@@ -43,6 +43,15 @@ static struct spinlock tx_lock;
 static int tx_busy;           // is the UART busy sending?
 static int tx_chan;           // &tx_chan is the "wait channel"
 
+// input taken from the UART by uartintr(), for uartinput().
+#define RX_BUF_SIZE 64
+static struct spinlock rx_lock;
+static uchar rx_buf[RX_BUF_SIZE];
+static uint rx_r;             // read index
+static uint rx_w;             // write index
+
+static void uartinput(void);
+
 extern volatile int panicking; // from printf.c
 extern volatile int panicked; // from printf.c
 
@@ -72,6 +81,8 @@ uartinit(void)
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
 
   initlock(&tx_lock, "uart");
+  initlock(&rx_lock, "uart_rx");
+  irqdefer(UART0_IRQ, uartinput, "uart");
 }
 
 // transmit buf[] to the uart. it blocks if the
@@ -138,10 +149,14 @@ uartgetc(void)
 
 // handle a uart interrupt, raised because input has
 // arrived, or the uart is ready for more output, or
-// both. called from devintr().
+// both. called from devintr(). input goes to the
+// console from uartinput(), in the uart's interrupt
+// thread; here it only has to be taken from the uart.
 void
 uartintr(void)
 {
+  int c;
+
   ReadReg(ISR); // acknowledge the interrupt
 
   acquire(&tx_lock);
@@ -152,11 +167,30 @@ uartintr(void)
   }
   release(&tx_lock);
 
-  // read and process incoming characters.
-  while(1){
-    int c = uartgetc();
-    if(c == -1)
-      break;
+  // read incoming characters, dropping any that
+  // don't fit.
+  acquire(&rx_lock);
+  while((c = uartgetc()) != -1){
+    if(rx_w - rx_r < RX_BUF_SIZE)
+      rx_buf[rx_w++ % RX_BUF_SIZE] = c;
+  }
+  release(&rx_lock);
+
+  irqwake(UART0_IRQ);
+}
+
+// pass input that uartintr() took to the console.
+static void
+uartinput(void)
+{
+  int c;
+
+  acquire(&rx_lock);
+  while(rx_r != rx_w){
+    c = rx_buf[rx_r++ % RX_BUF_SIZE];
+    release(&rx_lock);
     consoleintr(c);
+    acquire(&rx_lock);
   }
+  release(&rx_lock);
 }
@@ -58,12 +58,15 @@ static struct disk {
   
 } disk;
 
+static void virtio_disk_done(void);
+
 void
 virtio_disk_init(void)
 {
   uint32 status = 0;
 
   initlock(&disk.vdisk_lock, "virtio_disk");
+  irqdefer(VIRTIO0_IRQ, virtio_disk_done, "virtio_disk");
 
   if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
      *R(VIRTIO_MMIO_VERSION) != 2 ||
@@ -178,7 +181,6 @@ free_desc(int i)
   disk.desc[i].flags = 0;
   disk.desc[i].next = 0;
   disk.free[i] = 1;
-  wakeup(&disk.free[0]);
 }
 
 // free a chain of descriptors.
@@ -194,6 +196,9 @@ free_chain(int i)
     else
       break;
   }
+  // a chain is the three descriptors one waiting
+  // virtio_disk_rw() needs.
+  wakeupone(&disk.free[0]);
 }
 
 // allocate three descriptors (they need not be contiguous).
@@ -291,19 +296,29 @@ virtio_disk_rw(struct buf *b, int write)
   release(&disk.vdisk_lock);
 }
 
+// the disk interrupt. only acknowledge it here, and leave
+// the completions to virtio_disk_done() in the disk's
+// interrupt thread.
 void
 virtio_disk_intr()
 {
-  acquire(&disk.vdisk_lock);
-
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
   // this may race with the device writing new entries to
-  // the "used" ring, in which case we may process the new
-  // completion entries in this interrupt, and have nothing to do
-  // in the next interrupt, which is harmless.
+  // the "used" ring, in which case virtio_disk_done() may
+  // process the new completion entries for this interrupt,
+  // and have nothing to do for the next one, which is harmless.
   *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
+  irqwake(VIRTIO0_IRQ);
+}
+
+// wake the processes whose requests have completed.
+static void
+virtio_disk_done(void)
+{
+  acquire(&disk.vdisk_lock);
+
   __sync_synchronize();
 
   // the device increments disk.used->idx when it
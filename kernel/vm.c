@@ -7,6 +7,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "fs.h"
+#include "pcount.h"
 
 /*
  * the kernel's page table.
@@ -32,6 +33,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT software interrupt registers, for IPIs
+  kvmmap(kpgtbl, CLINT, CLINT, PGSIZE, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x4000000, PTE_R | PTE_W);
 
@@ -257,6 +261,37 @@ uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
   return newsz;
 }
 
+// Like uvmdealloc(), for a page table that other CPUs may be
+// running threads on: unmap a batch of pages, wait until no
+// CPU can still reach them through its TLB, then free them.
+uint64
+uvmdeallocshared(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
+{
+  uint64 batch[32];
+  uint64 a, end;
+  pte_t *pte;
+  int i, n;
+
+  if(newsz >= oldsz)
+    return oldsz;
+
+  end = PGROUNDUP(oldsz);
+  for(a = PGROUNDUP(newsz); a < end; ){
+    n = 0;
+    for(; a < end && n < NELEM(batch); a += PGSIZE){
+      if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        continue;
+      batch[n++] = PTE2PA(*pte);
+      *pte = 0;
+    }
+    tlbshootdown(pagetable);
+    for(i = 0; i < n; i++)
+      kfree((void*)batch[i]);
+  }
+
+  return newsz;
+}
+
 // Recursively free page-table pages.
 // All leaf mappings must already have been removed.
 void
@@ -288,20 +323,25 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 }
 
 // Given a parent process's page table, copy
-// its memory into a child's page table.
+// its memory, *szp bytes of it, into a child's page table.
 // Copies both the page table and the
 // physical memory.
-// returns 0 on success, -1 on failure.
+// lk, which the caller holds, guards old and *szp; every
+// so often uvmcopy() lets other work run, dropping lk for
+// a moment, so *szp may change along the way.
+// returns the size copied, or -1 on failure.
 // frees any allocated pages on failure.
-int
-uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
+uint64
+uvmcopy(pagetable_t old, pagetable_t new, uint64 *szp, struct spinlock *lk)
 {
   pte_t *pte;
   uint64 pa, i;
   uint flags;
   char *mem;
 
-  for(i = 0; i < sz; i += PGSIZE){
+  for(i = 0; i < *szp; i += PGSIZE){
+    if((i / PGSIZE) % COPYBATCH == 0 && condresched(lk) && i >= *szp)
+      break;
     if((pte = walk(old, i, 0)) == 0)
       continue;   // page table entry hasn't been allocated
     if((*pte & PTE_V) == 0)
@@ -316,7 +356,10 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       goto err;
     }
   }
-  return 0;
+  // the parent may have shrunk while lk was dropped.
+  if(i > *szp)
+    uvmdealloc(new, i, *szp);
+  return *szp;
 
  err:
   uvmunmap(new, 0, i / PGSIZE, 1);
@@ -336,6 +379,28 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Look up the physical address of user page va0 for a copy,
+// faulting it in first if it was lazily allocated and alloc
+// is set. Returns with the group lock held, so that a sibling
+// thread's sbrk() can't unmap and free the page while the
+// caller copies; the caller must release it. Returns 0,
+// without the lock, if va0 isn't mapped.
+static uint64
+upage(pagetable_t pagetable, uint64 va0, int alloc)
+{
+  struct proc *g = myproc()->leader;
+  uint64 pa0;
+
+  for(;;){
+    acquire(&g->glock);
+    if((pa0 = walkaddr(pagetable, va0)) != 0)
+      return pa0;
+    release(&g->glock);
+    if(!alloc || vmfault(pagetable, va0, 0) == 0)
+      return 0;
+  }
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -344,28 +409,28 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
   pte_t *pte;
+  struct proc *g = myproc()->leader;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     if(va0 >= MAXVA)
       return -1;
   
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0) {
-      if((pa0 = vmfault(pagetable, va0, 0)) == 0) {
-        return -1;
-      }
-    }
+    if((pa0 = upage(pagetable, va0, 1)) == 0)
+      return -1;
 
     pte = walk(pagetable, va0, 0);
     // forbid copyout over read-only user text pages.
-    if((*pte & PTE_W) == 0)
+    if((*pte & PTE_W) == 0){
+      release(&g->glock);
       return -1;
+    }
       
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
     memmove((void *)(pa0 + (dstva - va0)), src, n);
+    release(&g->glock);
 
     len -= n;
     src += n;
@@ -381,19 +446,17 @@ int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
   uint64 n, va0, pa0;
+  struct proc *g = myproc()->leader;
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0) {
-      if((pa0 = vmfault(pagetable, va0, 0)) == 0) {
-        return -1;
-      }
-    }
+    if((pa0 = upage(pagetable, va0, 1)) == 0)
+      return -1;
     n = PGSIZE - (srcva - va0);
     if(n > len)
       n = len;
     memmove(dst, (void *)(pa0 + (srcva - va0)), n);
+    release(&g->glock);
 
     len -= n;
     dst += n;
@@ -411,11 +474,11 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
   uint64 n, va0, pa0;
   int got_null = 0;
+  struct proc *g = myproc()->leader;
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if((pa0 = upage(pagetable, va0, 0)) == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
     if(n > max)
@@ -435,6 +498,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
       p++;
       dst++;
     }
+    release(&g->glock);
 
     srcva = va0 + PGSIZE;
   }
@@ -453,23 +517,44 @@ uint64
 vmfault(pagetable_t pagetable, uint64 va, int read)
 {
   uint64 mem;
-  struct proc *p = myproc();
-
-  if (va >= p->sz)
-    return 0;
+  struct proc *g = myproc()->leader;
+  int tries = 0;
+
+  // threads share the page table, and two of them may
+  // fault on the same page at once.
+ again:
+  acquire(&g->glock);
+  if (va >= g->sz)
+    goto bad;
   va = PGROUNDDOWN(va);
   if(ismapped(pagetable, va)) {
-    return 0;
+    // another thread got here first. A fault on a writable
+    // page can't be anything else.
+    pte_t *pte = walk(pagetable, va, 0);
+    if((*pte & (PTE_W|PTE_U)) != (PTE_W|PTE_U))
+      goto bad;
+    release(&g->glock);
+    return PTE2PA(*pte);
   }
   mem = (uint64) kalloc();
-  if(mem == 0)
+  if(mem == 0){
+    release(&g->glock);
+    if(tries++ < RECLAIMTRIES && reclaimwait())
+      goto again;
     return 0;
+  }
+  pcountinc(PC_PGFAULT);
   memset((void *) mem, 0, PGSIZE);
-  if (mappages(p->pagetable, va, PGSIZE, mem, PTE_W|PTE_U|PTE_R) != 0) {
+  if (mappages(g->pagetable, va, PGSIZE, mem, PTE_W|PTE_U|PTE_R) != 0) {
     kfree((void *)mem);
-    return 0;
+    goto bad;
   }
+  release(&g->glock);
   return mem;
+
+ bad:
+  release(&g->glock);
+  return 0;
 }
 
 int
@@ -0,0 +1,105 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/sched.h"
+#include "user/user.h"
+
+// Run a command under a scheduling policy, or show or
+// change the policy of a running process. The real-time
+// policies, fifo and rr, take a priority from 1 to NRTPRIO.
+//
+//   chrt mlfq|fair cmd [args...]
+//   chrt fifo|rr prio cmd [args...]
+//   chrt -p pid [mlfq|fair | fifo|rr prio]
+
+static char *policies[] = {
+  [SCHED_MLFQ] "mlfq",
+  [SCHED_FAIR] "fair",
+  [SCHED_FIFO] "fifo",
+  [SCHED_RR]   "rr",
+};
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: chrt mlfq|fair cmd [args...]\n");
+  fprintf(2, "       chrt fifo|rr prio cmd [args...]\n");
+  fprintf(2, "       chrt -p pid [mlfq|fair | fifo|rr prio]\n");
+  exit(1);
+}
+
+static int
+policy(char *name)
+{
+  for(int i = 0; i < sizeof(policies)/sizeof(policies[0]); i++)
+    if(strcmp(name, policies[i]) == 0)
+      return i;
+  fprintf(2, "chrt: unknown policy %s\n", name);
+  exit(1);
+}
+
+// Parse a policy and, for a real-time one, its priority
+// from argv. Returns the number of arguments used.
+static int
+parse(char **argv, int argc, int *pol, int *prio)
+{
+  *pol = policy(argv[0]);
+  *prio = 0;
+  if(!RTPOLICY(*pol))
+    return 1;
+  if(argc < 2)
+    usage();
+  *prio = atoi(argv[1]);
+  if(*prio < 1 || *prio > NRTPRIO){
+    fprintf(2, "chrt: priority must be 1 to %d\n", NRTPRIO);
+    exit(1);
+  }
+  return 2;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, pol, prio, n;
+
+  if(argc < 3)
+    usage();
+
+  if(strcmp(argv[1], "-p") == 0){
+    pid = atoi(argv[2]);
+    if(argc > 3){
+      parse(&argv[3], argc - 3, &pol, &prio);
+      if(setsched(pid, pol, prio) < 0){
+        fprintf(2, "chrt: setsched %d failed\n", pid);
+        exit(1);
+      }
+    }
+    if((pol = getsched(pid, &prio)) < 0){
+      fprintf(2, "chrt: no process %d\n", pid);
+      exit(1);
+    }
+    if(RTPOLICY(pol))
+      printf("pid %d: %s %d\n", pid, policies[pol], prio);
+    else
+      printf("pid %d: %s\n", pid, policies[pol]);
+    exit(0);
+  }
+
+  n = 1 + parse(&argv[1], argc - 1, &pol, &prio);
+  if(n >= argc)
+    usage();
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "chrt: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    setsched(0, pol, prio);
+    exec(argv[n], &argv[n]);
+    fprintf(2, "chrt: exec %s failed\n", argv[n]);
+    exit(1);
+  }
+
+  wait(0);
+  exit(0);
+}
@@ -1,11 +1,22 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "kernel/reclaim.h"
 #include "user/user.h"
 
 int
 main(void)
 {
+  struct reclaimstat st;
   int k = freemem();
+
   printf("%d KiB\n", k);
+  if(reclaimstat(&st) == 0){
+    printf("awaiting reclaim: %ld KiB in %ld processes\n",
+           st.pendingpages * (PGSIZE / 1024), st.npending);
+    printf("reclaimed: %ld KiB in %ld processes, %ld freed by exit\n",
+           st.reclaimed * (PGSIZE / 1024), st.nreclaimed, st.ninline);
+    printf("allocations that waited for reclaim: %ld\n", st.nwaits);
+  }
   exit(0);
 }
@@ -0,0 +1,58 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/irqoff.h"
+#include "user/user.h"
+
+// Show where the kernel keeps interrupts off longest, and
+// so can't preempt the process running there. Needs a
+// kernel built with make LATTRACE=1; resolve the pcs with
+// addr2line -e kernel/kernel.
+//
+//   irqoff              since boot
+//   irqoff -r           since boot, then start over
+//   irqoff cmd [args]   while cmd runs
+
+int
+main(int argc, char *argv[])
+{
+  static struct irqoff sites[NIRQOFF];
+  struct irqoff t;
+  int n, i, j, pid;
+
+  if(argc >= 2 && strcmp(argv[1], "-r") != 0){
+    if(irqoffstat(sites, 0, 1) < 0)
+      goto notraced;
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "irqoff: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], &argv[1]);
+      fprintf(2, "irqoff: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  if((n = irqoffstat(sites, NIRQOFF, argc == 2 && strcmp(argv[1], "-r") == 0)) < 0)
+    goto notraced;
+
+  // longest first
+  for(i = 1; i < n; i++){
+    t = sites[i];
+    for(j = i; j > 0 && sites[j-1].max < t.max; j--)
+      sites[j] = sites[j-1];
+    sites[j] = t;
+  }
+
+  printf("pc  max us  avg us  count\n");
+  for(i = 0; i < n; i++)
+    printf("0x%lx  %d  %d  %ld\n", sites[i].pc, (int)sites[i].max,
+           (int)(sites[i].total / sites[i].count), sites[i].count);
+  exit(0);
+
+notraced:
+  fprintf(2, "irqoff: kernel built without LATTRACE\n");
+  exit(1);
+}
@@ -0,0 +1,35 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Show which CPU takes each device interrupt, or send an
+// IRQ to another CPU. The IRQ's interrupt thread moves
+// there too.
+//
+//   irqroute            the uart (10) and disk (1) IRQs
+//   irqroute irq cpu
+
+int
+main(int argc, char *argv[])
+{
+  static int irqs[] = { 10, 1 };
+  static char *names[] = { "uart", "virtio disk" };
+  int irq, cpu;
+
+  if(argc == 1){
+    for(int i = 0; i < 2; i++)
+      printf("irq %d (%s): cpu %d\n", irqs[i], names[i], irqroute(irqs[i], -1));
+    exit(0);
+  }
+  if(argc != 3){
+    fprintf(2, "usage: irqroute [irq cpu]\n");
+    exit(1);
+  }
+  irq = atoi(argv[1]);
+  cpu = atoi(argv[2]);
+  if(irqroute(irq, cpu) < 0){
+    fprintf(2, "irqroute: can't send irq %d to cpu %d\n", irq, cpu);
+    exit(1);
+  }
+  exit(0);
+}
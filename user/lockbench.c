@@ -0,0 +1,81 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Compare the kernel's ticket spinlocks with test-and-set
+// locks under contention. One process per CPU takes and
+// releases a lock in the kernel the same number of times;
+// the slowest one's time gives the throughput, and the
+// spread between fastest and slowest shows how unfairly
+// the lock was handed out.
+//
+//   lockbench [rounds]
+
+static void
+run(char *what, int tas, int rounds)
+{
+  int start[2], done[2];
+  uint64 mask;
+  int nmig, ncpu = 0, us, min = 0, max = 0;
+  char c = 0;
+
+  getaffinity(0, &mask, &nmig);
+  if(pipe(start) < 0 || pipe(done) < 0){
+    fprintf(2, "lockbench: pipe failed\n");
+    exit(1);
+  }
+  for(int cpu = 0; cpu < 64; cpu++){
+    if((mask & (1UL << cpu)) == 0)
+      continue;
+    ncpu++;
+    int pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      // moves to cpu by the next tick at the latest.
+      setaffinity(0, 1UL << cpu);
+      read(start[0], &c, 1);
+      us = lockbench(tas, rounds);
+      write(done[1], &us, sizeof(us));
+      exit(0);
+    }
+  }
+  for(int i = 0; i < ncpu; i++)
+    write(start[1], &c, 1);
+  for(int i = 0; i < ncpu; i++){
+    if(read(done[0], &us, sizeof(us)) != sizeof(us)){
+      fprintf(2, "lockbench: lost a result\n");
+      exit(1);
+    }
+    if(i == 0 || us < min)
+      min = us;
+    if(us > max)
+      max = us;
+  }
+  for(int i = 0; i < ncpu; i++)
+    wait(0);
+  close(start[0]);
+  close(start[1]);
+  close(done[0]);
+  close(done[1]);
+
+  printf("%s: %d cpus, %d ns per acquire, slowest cpu %d us, fastest %d us\n",
+         what, ncpu, (int)((uint64)max * 1000 / ((uint64)rounds * ncpu)),
+         max, min);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+
+  if(rounds < 1){
+    fprintf(2, "usage: lockbench [rounds]\n");
+    exit(1);
+  }
+  run("test-and-set", 1, rounds);
+  run("ticket", 0, rounds);
+  exit(0);
+}
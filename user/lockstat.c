@@ -0,0 +1,71 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+// Show the most contended kernel locks, by total time spent
+// waiting for them. Needs a kernel built with make
+// LOCKSTAT=1. Locks are grouped by name; "s" marks sleep
+// locks. Times are in microseconds.
+//
+//   lockstat [-n top]              since boot
+//   lockstat [-n top] -r           since boot, then start over
+//   lockstat [-n top] cmd [args]   while cmd runs
+
+#define US(cycles) ((cycles) / (TIMEBASE/1000000))
+
+int
+main(int argc, char *argv[])
+{
+  static struct lockstat st[NLOCKSTAT];
+  struct lockstat t;
+  int top = 10, reset = 0, n, i, j, pid;
+
+  if(argc >= 3 && strcmp(argv[1], "-n") == 0){
+    top = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
+  if(argc == 2 && strcmp(argv[1], "-r") == 0){
+    reset = 1;
+  } else if(argc >= 2){
+    if(lockstat(st, 0, 1) < 0)
+      goto nostats;
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], &argv[1]);
+      fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  if((n = lockstat(st, NLOCKSTAT, reset)) < 0)
+    goto nostats;
+
+  // most waited for first
+  for(i = 1; i < n; i++){
+    t = st[i];
+    for(j = i; j > 0 && st[j-1].waittime < t.waittime; j--)
+      st[j] = st[j-1];
+    st[j] = t;
+  }
+
+  printf("lock  acquires  contended  wait us  max hold us\n");
+  for(i = 0; i < n && i < top; i++){
+    if(st[i].acquires == 0)
+      continue;
+    printf("%s%s  %ld  %ld  %ld  %ld\n", st[i].name, st[i].sleep ? " (s)" : "",
+           st[i].acquires, st[i].contended, US(st[i].waittime), US(st[i].maxhold));
+  }
+  exit(0);
+
+nostats:
+  fprintf(2, "lockstat: kernel built without LOCKSTAT\n");
+  exit(1);
+}
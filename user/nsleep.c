@@ -0,0 +1,41 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Sleep with nanosleep() and report how long each sleep
+// actually took, measured with the real-time clock.
+//
+//   nsleep ns [count]
+
+int
+main(int argc, char *argv[])
+{
+  int ns, count;
+  uint start, took, total, worst;
+
+  if(argc < 2 || argc > 3){
+    fprintf(2, "usage: nsleep ns [count]\n");
+    exit(1);
+  }
+  ns = atoi(argv[1]);
+  count = argc == 3 ? atoi(argv[2]) : 1;
+  if(count < 1)
+    count = 1;
+
+  total = worst = 0;
+  for(int i = 0; i < count; i++){
+    // clock() is truncated to 32 bits, but unsigned
+    // differences stay right for sleeps under 4 seconds.
+    start = clock();
+    if(nanosleep(ns) < 0){
+      fprintf(2, "nsleep: nanosleep failed\n");
+      exit(1);
+    }
+    took = clock() - start;
+    total += took;
+    if(took > worst)
+      worst = took;
+  }
+  printf("asked %d ns: average %d ns, worst %d ns\n", ns, total / count, worst);
+  exit(0);
+}
@@ -0,0 +1,59 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Bounce a byte between two processes over a pair of pipes
+// and report the average round trip time, which is mostly
+// two wakeups and two context switches.
+//
+//   pingpong [rounds]
+
+int
+main(int argc, char *argv[])
+{
+  int ping[2], pong[2];
+  int rounds, pid;
+  uint start, took;
+  char c = 0;
+
+  rounds = argc > 1 ? atoi(argv[1]) : 10000;
+  if(rounds < 1){
+    fprintf(2, "usage: pingpong [rounds]\n");
+    exit(1);
+  }
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    fprintf(2, "pingpong: pipe failed\n");
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pingpong: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    close(ping[1]);
+    close(pong[0]);
+    while(read(ping[0], &c, 1) == 1)
+      write(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  // clock() is truncated to 32 bits, but unsigned
+  // differences stay right for runs under 4 seconds.
+  start = clock();
+  for(int i = 0; i < rounds; i++){
+    if(write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1){
+      fprintf(2, "pingpong: pipe broke\n");
+      exit(1);
+    }
+  }
+  took = clock() - start;
+
+  close(ping[1]);
+  wait(0);
+  printf("pingpong: %d round trips, %d ns each\n", rounds, took / rounds);
+  exit(0);
+}
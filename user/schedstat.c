@@ -0,0 +1,127 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/sched.h"
+#include "kernel/pcount.h"
+#include "user/user.h"
+
+// Show scheduler statistics: how long processes wait on
+// run queues, how long they run once they get a CPU, and
+// how often they give it up or are preempted, and how often
+// priority inheritance lent them a sleep lock waiter's rank.
+// For CPUs, also count system calls, interrupts and page
+// allocations.
+//
+//   schedstat              totals for each CPU
+//   schedstat -p pid       one process
+//   schedstat cmd [args]   each CPU, while cmd runs
+
+static void
+hist(char *what, uint64 *h)
+{
+  printf("  %s:\n", what);
+  for(int i = 0; i < NSCHEDHIST; i++){
+    if(h[i] == 0)
+      continue;
+    if(i == 0)
+      printf("    < %d us: %ld\n", 2, h[i]);
+    else if(i == NSCHEDHIST-1)
+      printf("    >= %d us: %ld\n", 1 << i, h[i]);
+    else
+      printf("    %d-%d us: %ld\n", 1 << i, (1 << (i+1)) - 1, h[i]);
+  }
+}
+
+static void
+show(struct schedstat *st)
+{
+  uint64 n = st->nvcsw + st->nivcsw;
+
+  printf("  switches: %ld voluntary, %ld involuntary\n", st->nvcsw, st->nivcsw);
+  printf("  direct switches: %ld\n", st->ndirect);
+  printf("  priority inheritance boosts: %ld\n", st->npiboost);
+  if(n > 0)
+    printf("  average: wait %ld us, slice %ld us\n", st->waittime / n,
+           st->runtime / n);
+  hist("run queue wait", st->wait);
+  hist("time slice", st->slice);
+}
+
+static void
+events(uint64 *n)
+{
+  printf("  events: %ld syscalls, %ld device intrs, %ld timer intrs, %ld IPIs\n",
+         n[PC_SYSCALL], n[PC_DEVINTR], n[PC_TIMER], n[PC_IPI]);
+  printf("  pages: %ld allocated, %ld freed, %ld faulted in\n",
+         n[PC_KALLOC], n[PC_KFREE], n[PC_PGFAULT]);
+}
+
+// Subtract b from a, to get what happened in between.
+static void
+diff(struct schedstat *a, struct schedstat *b)
+{
+  for(int i = 0; i < NSCHEDHIST; i++){
+    a->wait[i] -= b->wait[i];
+    a->slice[i] -= b->slice[i];
+  }
+  a->waittime -= b->waittime;
+  a->runtime -= b->runtime;
+  a->nvcsw -= b->nvcsw;
+  a->nivcsw -= b->nivcsw;
+  a->npiboost -= b->npiboost;
+  a->ndirect -= b->ndirect;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static struct schedstat before[NCPU], after[NCPU];
+  static uint64 nbefore[NCPU][NPCOUNT], nafter[NCPU][NPCOUNT];
+  int pid, cpu;
+
+  if(argc >= 2 && strcmp(argv[1], "-p") == 0){
+    if(argc != 3){
+      fprintf(2, "usage: schedstat [-p pid | cmd [args...]]\n");
+      exit(1);
+    }
+    pid = atoi(argv[2]);
+    if(schedstat(pid, -1, &after[0]) < 0){
+      fprintf(2, "schedstat: no process %d\n", pid);
+      exit(1);
+    }
+    printf("pid %d:\n", pid);
+    show(&after[0]);
+    exit(0);
+  }
+
+  if(argc >= 2){
+    for(cpu = 0; cpu < NCPU; cpu++){
+      schedstat(0, cpu, &before[cpu]);
+      pcount(cpu, nbefore[cpu]);
+    }
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "schedstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], &argv[1]);
+      fprintf(2, "schedstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+
+  for(cpu = 0; cpu < NCPU; cpu++){
+    if(schedstat(0, cpu, &after[cpu]) < 0)
+      continue;
+    diff(&after[cpu], &before[cpu]);
+    pcount(cpu, nafter[cpu]);
+    for(int i = 0; i < NPCOUNT; i++)
+      nafter[cpu][i] -= nbefore[cpu][i];
+    printf("cpu %d:\n", cpu);
+    show(&after[cpu]);
+    events(nafter[cpu]);
+  }
+  exit(0);
+}
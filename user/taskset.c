@@ -0,0 +1,89 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Run a command on a set of CPUs, or show or change the
+// CPUs a running process may use. Masks are in hex; bit i
+// stands for CPU i.
+//
+//   taskset mask cmd [args...]
+//   taskset -p pid [mask]
+
+static uint64
+mask(char *s)
+{
+  uint64 m = 0;
+  int d;
+
+  if(s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+    s += 2;
+  if(*s == 0)
+    goto bad;
+  for(; *s; s++){
+    if(*s >= '0' && *s <= '9')
+      d = *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      d = *s - 'a' + 10;
+    else if(*s >= 'A' && *s <= 'F')
+      d = *s - 'A' + 10;
+    else
+      goto bad;
+    m = (m << 4) | d;
+  }
+  if(m != 0)
+    return m;
+bad:
+  fprintf(2, "taskset: bad mask\n");
+  exit(1);
+}
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: taskset mask cmd [args...]\n");
+  fprintf(2, "       taskset -p pid [mask]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, nmig;
+  uint64 m;
+
+  if(argc < 3)
+    usage();
+
+  if(strcmp(argv[1], "-p") == 0){
+    pid = atoi(argv[2]);
+    if(argc > 3 && setaffinity(pid, mask(argv[3])) < 0){
+      fprintf(2, "taskset: setaffinity %d failed\n", pid);
+      exit(1);
+    }
+    if(getaffinity(pid, &m, &nmig) < 0){
+      fprintf(2, "taskset: no process %d\n", pid);
+      exit(1);
+    }
+    printf("pid %d: mask 0x%lx, %d migrations\n", pid, m, nmig);
+    exit(0);
+  }
+
+  m = mask(argv[1]);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "taskset: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    if(setaffinity(0, m) < 0){
+      fprintf(2, "taskset: no running CPU in mask\n");
+      exit(1);
+    }
+    exec(argv[2], &argv[2]);
+    fprintf(2, "taskset: exec %s failed\n", argv[2]);
+    exit(1);
+  }
+
+  wait(0);
+  exit(0);
+}
@@ -0,0 +1,186 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+
+// Threads on top of clone() and join(). Each thread gets
+// a malloc()ed stack, freed again by thread_join(). Neither
+// malloc() nor the table below is locked, so only one
+// thread at a time may create and join threads.
+//
+// Mutexes, condition variables and semaphores on top of
+// futex_wait() and futex_wake(). They only enter the
+// kernel to block, or to wake a thread that has blocked.
+
+#define TSTACK (4*PGSIZE)
+
+struct tstart {
+  void (*fn)(void*);
+  void *arg;
+};
+
+static struct {
+  int tid;
+  char *stack;
+} threads[NTHREAD];
+
+// First thing a new thread runs, with its start record at
+// the top of its stack. Returning from fn ends the thread.
+static void
+threadmain(void *a)
+{
+  struct tstart *s = a;
+
+  s->fn(s->arg);
+  exit(0);
+}
+
+// Start a thread running fn(arg). Returns its id, or -1.
+int
+thread_create(void (*fn)(void*), void *arg)
+{
+  struct tstart *s;
+  char *stack;
+  int i, tid;
+
+  for(i = 0; i < NTHREAD; i++)
+    if(threads[i].stack == 0)
+      break;
+  if(i == NTHREAD)
+    return -1;
+  if((stack = malloc(TSTACK)) == 0)
+    return -1;
+
+  s = (struct tstart *)((uint64)(stack + TSTACK - sizeof(*s)) & ~0xfUL);
+  s->fn = fn;
+  s->arg = arg;
+  if((tid = clone(threadmain, s, s)) < 0){
+    free(stack);
+    return -1;
+  }
+  threads[i].tid = tid;
+  threads[i].stack = stack;
+  return tid;
+}
+
+// Wait for thread tid (any thread, if tid is 0) to finish,
+// and free its stack. Returns its id, or -1.
+int
+thread_join(int tid)
+{
+  int i;
+
+  if((tid = join(tid)) < 0)
+    return -1;
+  for(i = 0; i < NTHREAD; i++){
+    if(threads[i].stack && threads[i].tid == tid){
+      free(threads[i].stack);
+      threads[i].stack = 0;
+      break;
+    }
+  }
+  return tid;
+}
+
+// Mutex states.
+#define UNLOCKED 0
+#define LOCKED   1
+#define WAITERS  2  // locked, and someone may be sleeping
+
+void
+mutex_lock(struct mutex *m)
+{
+  int c = UNLOCKED;
+
+  if(__atomic_compare_exchange_n(&m->state, &c, LOCKED, 0,
+                                 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+  // contended: mark the mutex so that the holder's unlock
+  // wakes us, and sleep until we get it.
+  if(c != WAITERS)
+    c = __atomic_exchange_n(&m->state, WAITERS, __ATOMIC_ACQUIRE);
+  while(c != UNLOCKED){
+    futex_wait(&m->state, WAITERS, 0);
+    c = __atomic_exchange_n(&m->state, WAITERS, __ATOMIC_ACQUIRE);
+  }
+}
+
+// Returns 1 if m was taken, 0 if it was already held.
+int
+mutex_trylock(struct mutex *m)
+{
+  int c = UNLOCKED;
+
+  return __atomic_compare_exchange_n(&m->state, &c, LOCKED, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+void
+mutex_unlock(struct mutex *m)
+{
+  if(__atomic_exchange_n(&m->state, UNLOCKED, __ATOMIC_RELEASE) == WAITERS)
+    futex_wake(&m->state, 1);
+}
+
+// Release m, wait for cond_signal() or cond_broadcast()
+// on c, and take m again. As with any condition variable,
+// the caller must re-check its condition on return.
+void
+cond_wait(struct cond *c, struct mutex *m)
+{
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+
+  mutex_unlock(m);
+  // a signal after the unlock changes seq, so the
+  // futex_wait() won't sleep through it.
+  futex_wait(&c->seq, seq, 0);
+  mutex_lock(m);
+}
+
+void
+cond_signal(struct cond *c)
+{
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 1);
+}
+
+void
+cond_broadcast(struct cond *c)
+{
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, -1);
+}
+
+void
+sem_init(struct sem *s, int count)
+{
+  s->count = count;
+  s->waiters = 0;
+}
+
+void
+sem_wait(struct sem *s)
+{
+  int c;
+
+  for(;;){
+    c = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+    if(c > 0){
+      if(__atomic_compare_exchange_n(&s->count, &c, c - 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+      continue;
+    }
+    __atomic_fetch_add(&s->waiters, 1, __ATOMIC_SEQ_CST);
+    futex_wait(&s->count, 0, 0);
+    __atomic_fetch_sub(&s->waiters, 1, __ATOMIC_RELAXED);
+  }
+}
+
+void
+sem_post(struct sem *s)
+{
+  __atomic_fetch_add(&s->count, 1, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&s->waiters, __ATOMIC_SEQ_CST) > 0)
+    futex_wake(&s->count, 1);
+}
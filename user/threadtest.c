@@ -0,0 +1,150 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Sum an array with several threads, each adding up its
+// own slice into a shared result table, and check the
+// total against a single-threaded sum. Then check that a
+// futex mutex keeps a shared counter right, and pass
+// values from a producer to a consumer through a ring
+// guarded by semaphores.
+//
+//   threadtest [nthreads]
+
+#define N 100000
+#define MAXT 8
+#define NINC 10000
+#define NRING 4
+
+static int data[N];
+static uint64 partial[MAXT];
+static int nthreads;
+
+static struct mutex mu;
+static int counter;
+
+static struct sem slots, items;
+static struct mutex ringmu;
+static int ring[NRING], rhead, rtail;
+static uint64 consumed;
+
+static void
+sum(void *arg)
+{
+  int t = (int)(uint64)arg;
+  uint64 s = 0;
+
+  for(int i = t; i < N; i += nthreads)
+    s += data[i];
+  partial[t] = s;
+}
+
+static void
+inc(void *arg)
+{
+  for(int i = 0; i < NINC; i++){
+    mutex_lock(&mu);
+    counter++;
+    mutex_unlock(&mu);
+  }
+}
+
+static void
+produce(void *arg)
+{
+  for(int i = 1; i <= NINC; i++){
+    sem_wait(&slots);
+    mutex_lock(&ringmu);
+    ring[rhead++ % NRING] = i;
+    mutex_unlock(&ringmu);
+    sem_post(&items);
+  }
+}
+
+static void
+consume(void *arg)
+{
+  int v;
+
+  for(int i = 0; i < NINC; i++){
+    sem_wait(&items);
+    mutex_lock(&ringmu);
+    v = ring[rtail++ % NRING];
+    consumed += v;
+    mutex_unlock(&ringmu);
+    sem_post(&slots);
+  }
+}
+
+// Run fn in nthreads threads and wait for all of them.
+static void
+runall(void (*fn)(void*))
+{
+  int tids[MAXT];
+
+  for(int t = 0; t < nthreads; t++){
+    if((tids[t] = thread_create(fn, (void *)(uint64)t)) < 0){
+      fprintf(2, "threadtest: thread_create failed\n");
+      exit(1);
+    }
+  }
+  for(int t = 0; t < nthreads; t++){
+    if(thread_join(tids[t]) != tids[t]){
+      fprintf(2, "threadtest: thread_join %d failed\n", tids[t]);
+      exit(1);
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint64 want, got;
+  int tids[2];
+
+  nthreads = argc > 1 ? atoi(argv[1]) : 4;
+  if(nthreads < 1 || nthreads > MAXT){
+    fprintf(2, "usage: threadtest [1-%d]\n", MAXT);
+    exit(1);
+  }
+
+  want = 0;
+  for(int i = 0; i < N; i++){
+    data[i] = i * 7 + 3;
+    want += data[i];
+  }
+
+  runall(sum);
+
+  got = 0;
+  for(int t = 0; t < nthreads; t++)
+    got += partial[t];
+  if(got != want){
+    printf("threadtest: FAILED, sum %ld, want %ld\n", got, want);
+    exit(1);
+  }
+
+  runall(inc);
+  if(counter != nthreads * NINC){
+    printf("threadtest: FAILED, counter %d, want %d\n", counter, nthreads * NINC);
+    exit(1);
+  }
+
+  sem_init(&slots, NRING);
+  sem_init(&items, 0);
+  tids[0] = thread_create(produce, 0);
+  tids[1] = thread_create(consume, 0);
+  if(tids[0] < 0 || tids[1] < 0 ||
+     thread_join(tids[0]) < 0 || thread_join(tids[1]) < 0){
+    fprintf(2, "threadtest: producer/consumer threads failed\n");
+    exit(1);
+  }
+  want = (uint64)NINC * (NINC + 1) / 2;
+  if(consumed != want){
+    printf("threadtest: FAILED, consumed %ld, want %ld\n", consumed, want);
+    exit(1);
+  }
+
+  printf("threadtest: %d threads OK\n", nthreads);
+  exit(0);
+}
@@ -1,6 +1,10 @@
 #define SBRK_ERROR ((char *)-1)
 
 struct stat;
+struct schedstat;
+struct irqoff;
+struct reclaimstat;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -33,6 +37,22 @@ int nice(int n);
 int getcwd(char *, int);
 int freemem(void);
 void* mmap(void);
+int setsched(int pid, int policy, int rtprio);
+int getsched(int pid, int *rtprio);
+int nanosleep(uint64 ns);
+int setaffinity(int pid, uint64 mask);
+int getaffinity(int pid, uint64 *mask, int *nmigrations);
+int schedstat(int pid, int cpu, struct schedstat *st);
+int clone(void (*fn)(void*), void *arg, void *stack);
+int join(int tid);
+int futex_wait(int *addr, int val, uint64 timeout);
+int futex_wake(int *addr, int n);
+int irqoffstat(struct irqoff *sites, int n, int reset);
+int reclaimstat(struct reclaimstat *st);
+int pcount(int cpu, uint64 *counts);
+int irqroute(int irq, int cpu);
+int lockbench(int tas, int n);
+int lockstat(struct lockstat *stats, int n, int reset);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -54,6 +74,23 @@ int getline(char **buf, int sizep, int fd);
 void fprintf(int, const char*, ...) __attribute__ ((format (printf, 2, 3)));
 void printf(const char*, ...) __attribute__ ((format (printf, 1, 2)));
 
+// thread.c
+// A zeroed mutex is unlocked and a zeroed cond is ready to use.
+struct mutex { int state; };
+struct cond { int seq; };
+struct sem { int count; int waiters; };
+int thread_create(void (*fn)(void*), void *arg);
+int thread_join(int tid);
+void mutex_lock(struct mutex*);
+int mutex_trylock(struct mutex*);
+void mutex_unlock(struct mutex*);
+void cond_wait(struct cond*, struct mutex*);
+void cond_signal(struct cond*);
+void cond_broadcast(struct cond*);
+void sem_init(struct sem*, int count);
+void sem_wait(struct sem*);
+void sem_post(struct sem*);
+
 // umalloc.c
 void* malloc(uint);
 void free(void*);
@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/sched.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -874,6 +875,65 @@ preempt(char *s)
   wait(0);
 }
 
+// a SCHED_FAIR process sharing a CPU with an MLFQ CPU hog
+// must still get some of it. the fair one writes a byte to
+// the pipe for each tick it sees go by while it runs.
+void
+fairshare(char *s)
+{
+  int pid1, pid2, n, total, t, last;
+  int pfds[2];
+
+  pid1 = fork();
+  if(pid1 < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid1 == 0){
+    setaffinity(0, 1);
+    for(;;)
+      ;
+  }
+
+  pipe(pfds);
+  pid2 = fork();
+  if(pid2 < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid2 == 0){
+    close(pfds[0]);
+    setaffinity(0, 1);
+    if(setsched(0, SCHED_FAIR, 0) < 0){
+      printf("%s: setsched failed\n", s);
+      exit(1);
+    }
+    last = uptime();
+    for(;;){
+      if((t = uptime()) != last)
+        write(pfds[1], "x", 1);
+      last = t;
+    }
+  }
+  close(pfds[1]);
+
+  pause(4*HZ);
+  kill(pid2);
+  kill(pid1);
+  wait(0);
+  wait(0);
+
+  total = 0;
+  while((n = read(pfds[0], buf, sizeof(buf))) > 0)
+    total += n;
+  close(pfds[0]);
+  // a quarter of each second is the fair class's.
+  if(total < 4){
+    printf("%s: fair process starved\n", s);
+    exit(1);
+  }
+}
+
 // try to find any races between exit and wait
 void
 exitwait(char *s)
@@ -1781,6 +1841,73 @@ bigfile(char *s)
   unlink("bigfile.dat");
 }
 
+// concurrent readers and writers over more distinct blocks
+// than the buffer cache holds, so that misses keep recycling
+// buffers, and stealing them from other hash buckets. every
+// block must read back what was last written to it.
+void
+bcachestress(char *s)
+{
+  enum { NCHILD=4, N=NBUF, ROUNDS=4 };
+  char *names[] = { "bc0", "bc1", "bc2", "bc3" };
+  int fd, pid, i, j, r, pi, xstatus;
+
+  for(pi = 0; pi < NCHILD; pi++){
+    unlink(names[pi]);
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      for(r = 0; r < ROUNDS; r++){
+        // rewrite every block with this round's pattern.
+        fd = open(names[pi], O_CREATE | O_RDWR);
+        if(fd < 0){
+          printf("%s: create failed\n", s);
+          exit(1);
+        }
+        for(i = 0; i < N; i++){
+          memset(buf, pi*ROUNDS*N + r*N + i, BSIZE);
+          if(write(fd, buf, BSIZE) != BSIZE){
+            printf("%s: write failed\n", s);
+            exit(1);
+          }
+        }
+        close(fd);
+
+        fd = open(names[pi], O_RDONLY);
+        if(fd < 0){
+          printf("%s: open failed\n", s);
+          exit(1);
+        }
+        for(i = 0; i < N; i++){
+          if(read(fd, buf, BSIZE) != BSIZE){
+            printf("%s: read failed\n", s);
+            exit(1);
+          }
+          for(j = 0; j < BSIZE; j++){
+            if(buf[j] != (char)(pi*ROUNDS*N + r*N + i)){
+              printf("%s: %s block %d holds stale data\n", s, names[pi], i);
+              exit(1);
+            }
+          }
+        }
+        close(fd);
+      }
+      exit(0);
+    }
+  }
+
+  for(pi = 0; pi < NCHILD; pi++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+  for(pi = 0; pi < NCHILD; pi++)
+    unlink(names[pi]);
+}
+
 void
 fourteen(char *s)
 {
@@ -2723,6 +2850,7 @@ struct test {
   {pipe1, "pipe1"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
+  {fairshare, "fairshare"},
   {exitwait, "exitwait"},
   {reparent, "reparent" },
   {twochildren, "twochildren"},
@@ -2740,6 +2868,7 @@ struct test {
   {subdir, "subdir"},
   {bigwrite, "bigwrite"},
   {bigfile, "bigfile"},
+  {bcachestress, "bcachestress"},
   {fourteen, "fourteen"},
   {rmdot, "rmdot"},
   {dirfile, "dirfile"},
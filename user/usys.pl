@@ -51,3 +51,19 @@ entry("nice");
 entry("getcwd");
 entry("freemem");
 entry("mmap");
+entry("setsched");
+entry("getsched");
+entry("nanosleep");
+entry("setaffinity");
+entry("getaffinity");
+entry("schedstat");
+entry("clone");
+entry("join");
+entry("futex_wait");
+entry("futex_wake");
+entry("irqoffstat");
+entry("reclaimstat");
+entry("pcount");
+entry("irqroute");
+entry("lockbench");
+entry("lockstat");